@@ -3,7 +3,29 @@
 
 #include "stdafx.h"
 #include<math.h>
+#include<string.h>
 #include"simulation.h"
+#include"aimpreview.h"
+#include"benchmark.h"
+#include"host.h"
+#include"publish.h"
+#include"vecenv.h"
+#include"fixedsim.h"
+#include"frustum.h"
+#include"offscreen.h"
+#include"capture.h"
+#include"renderqueue.h"
+#include"hud.h"
+#include"metrics.h"
+#include"alloctrack.h"
+#include<vector>
+#include<algorithm>
+#include<chrono>
+#ifdef _WIN32
+#include<windows.h>
+#else
+#include<time.h>
+#endif
 #include<glut.h>
 
 //cue variables
@@ -14,12 +36,12 @@ float gCueAngleSpeed = 2.0f; //radians per second
 float gCuePowerSpeed = 0.25f;
 float gCuePowerMax = 0.75;
 float gCuePowerMin = 0.1;
-float gCueBallFactor = 8.0;
+float gCueBallFactor = CUE_BALL_FACTOR;
 bool gDoCue = true;
 
 //camera variables
-vec3 gCamPos(0.0,0.7,2.1);
-vec3 gCamLookAt(0.0,0.0,0.0);
+vec4 gCamPos(0.0f,0.7f,2.1f);
+vec4 gCamLookAt(0.0f,0.0f,0.0f);
 bool gCamRotate = true;
 float gCamRotSpeed = 0.2;
 float gCamMoveSpeed = 0.5;
@@ -29,175 +51,174 @@ bool gCamU = false;
 bool gCamD = false;
 bool gCamZin = false;
 bool gCamZout = false;
+frustum gFrustum;	//kept in step with the projection and gluLookAt
+#define CAM_FOVY	(45.0f)
+#define CAM_NEAR	(0.2f)
+#define CAM_FAR		(1000.0f)
 particleSetMgr* gParticleSetMgr = particleSetMgr::Instance();
+aimPreview gAimPreview;
+statePublisher gPublisher;	//opened with --publish
+frameCapture gCapture;		//opened with --capture
+perfHud gHud;				//toggled with h
+int gWindowWidth = 0;
+int gWindowHeight = 0;
 //rendering options
 #define DRAW_SOLID	(0)
+#define WINDOW_WIDTH	(1000)
+#define WINDOW_HEIGHT	(700)
+#if DRAW_SOLID
+renderQueue gRenderQueue(32,32,true);
+#else
+renderQueue gRenderQueue(12,12,false);
+#endif
 
 void DoCamera(int ms)
 {
-	static const vec3 up(0.0,1.0,0.0);
+	static const vec4 up(0.0f,1.0f,0.0f);
+
+	if(!(gCamL||gCamR||gCamU||gCamD||gCamZin||gCamZout)) return;
+
+	//build the camera basis once per frame; every key below is a
+	//combination of these three directions
+	vec4 camDir = (gCamLookAt - gCamPos).Normalised3();
+	vec4 localR = camDir.Cross3(up);
+	vec4 localUp = localR.Cross3(camDir);
+	//signed key state: +1, -1 or 0 when both or neither are held
+	float side = (float)((gCamL?1:0) - (gCamR?1:0));
+	float vert = (float)((gCamU?1:0) - (gCamD?1:0));
+	float move = (gCamMoveSpeed*ms)/1000.0f;
 
 	if(gCamRotate)
 	{
-		if(gCamL)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localL = up.Cross(camDir);
-			vec3 inc = (localL* ((gCamRotSpeed*ms)/1000.0) );
-			gCamLookAt = gCamPos + camDir + inc;
-		}
-		if(gCamR)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localR = up.Cross(camDir);
-			vec3 inc = (localR* ((gCamRotSpeed*ms)/1000.0) );
-			gCamLookAt = gCamPos + camDir - inc;
-		}
-		if(gCamU)
+		if(side!=0.0f || vert!=0.0f)
 		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localR = camDir.Cross(up);
-			vec3 localUp = localR.Cross(camDir);
-			vec3 inc = (localUp* ((gCamMoveSpeed*ms)/1000.0) );
+			//left is up x dir, ie. -localR
+			vec4 inc = localR*(-side*((gCamRotSpeed*ms)/1000.0f));
+			inc = localUp.MulAdd(vert*move, inc);
 			gCamLookAt = gCamPos + camDir + inc;
+			camDir = (gCamLookAt - gCamPos).Normalised3();
 		}
-		if(gCamD)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localR = camDir.Cross(up);
-			vec3 localUp = localR.Cross(camDir);
-			vec3 inc = (localUp* ((gCamMoveSpeed*ms)/1000.0) );
-			gCamLookAt = gCamPos + camDir - inc;
-		}		
 	}
 	else
 	{
-		if(gCamL)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localL = up.Cross(camDir);
-			vec3 inc = (localL* ((gCamMoveSpeed*ms)/1000.0) );
-			gCamPos += inc;
-			gCamLookAt += inc;
-		}
-		if(gCamR)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localR = camDir.Cross(up);
-			vec3 inc = (localR* ((gCamMoveSpeed*ms)/1000.0) );
-			gCamPos += inc;
-			gCamLookAt += inc;
-		}
-		if(gCamU)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localR = camDir.Cross(up);
-			vec3 localUp = localR.Cross(camDir);
-			vec3 inc = (localUp* ((gCamMoveSpeed*ms)/1000.0) );
-			gCamPos += inc;
-			gCamLookAt += inc;
-		}
-		if(gCamD)
-		{
-			vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-			vec3 localR = camDir.Cross(up);
-			vec3 localDown = camDir.Cross(localR);
-			vec3 inc = (localDown* ((gCamMoveSpeed*ms)/1000.0) );
-			gCamPos += inc;
-			gCamLookAt += inc;
-		}
+		vec4 inc = localR*(-side*move);
+		inc = localUp.MulAdd(vert*move, inc);
+		gCamPos += inc;
+		gCamLookAt += inc;
 	}
 
-	if(gCamZin)
+	float zoom = (float)((gCamZin?1:0) - (gCamZout?1:0));
+	if(zoom!=0.0f)
 	{
-		vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-		vec3 inc = (camDir* ((gCamMoveSpeed*ms)/1000.0) );
+		vec4 inc = camDir*(zoom*move);
 		gCamPos += inc;
 		gCamLookAt += inc;
 	}
-	if(gCamZout)
-	{
-		vec3 camDir = (gCamLookAt - gCamPos).Normalised();
-		vec3 inc = (camDir* ((gCamMoveSpeed*ms)/1000.0) );
-		gCamPos -= inc;
-		gCamLookAt -= inc;
-	}
 }
 
+//everything but the buffer swap, so it can draw offscreen too. The
+//scene is recorded into gRenderQueue, which sorts it by state and
+//draws it with vertex arrays
+void DrawScene(void) {
+	static const uint32_t white = RENDER_RGB(255,255,255);
+	static const uint32_t red = RENDER_RGB(255,0,0);
+	static const uint32_t blue = RENDER_RGB(0,0,255);
 
-void RenderScene(void) {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	//set camera
 	glLoadIdentity();
 	gluLookAt(gCamPos(0),gCamPos(1),gCamPos(2),gCamLookAt(0),gCamLookAt(1),gCamLookAt(2),0.0f,1.0f,0.0f);
+	gFrustum.SetLookAt(gCamPos, gCamLookAt, vec4(0.0f,1.0f,0.0f));
+	gRenderQueue.Begin();
 	
-	//draw the particles
+	//the particles : whole sets off screen are skipped, and only
+	//sets crossing the edge test each particle
 	particleSet* ps;
 	particle* p;
 	for(gParticleSetMgr->ParticleSetBegin();gParticleSetMgr->HasNextParticleSet();){
 		ps = gParticleSetMgr->GetNextParticleSet();
+		int cull = gFrustum.ClassifySphere(ps->BoundsCentre(), ps->BoundsRadius());
+		if(cull==FRUSTUM_OUTSIDE) continue;
 		for(ps->ParticleIteratorBegin();ps->HasNextParticle();){
 			p = ps->GetNextParticle();
-			glColor3f(1.0,0.0,0.0);
-			glPushMatrix();
-			glTranslatef(p->position(0), p->position(1), p->position(2));
-			#if   DRAW_SOLID
-			glutSolidSphere(p.radius,32,32);
-			#else
-			glutWireSphere(p->radius,12,12);
-			#endif
-			glPopMatrix();
+			if(cull==FRUSTUM_INTERSECT && !gFrustum.SphereVisible(p->position, p->radius)) continue;
+			gRenderQueue.Sphere(LAYER_SCENE, p->position, p->radius, red);
 		}
 	}
 
-
-	//draw the ball
-	glColor3f(1.0,1.0,1.0);
-	for(int i=0;i<NUM_BALLS;i++)
+	//the balls : the cue ball white, the rest blue
+	for(int i=0;i<gTable.NumBalls();i++)
 	{
-		glPushMatrix();
-		glTranslatef(gTable.balls[i].position(0),(BALL_RADIUS/2.0),gTable.balls[i].position(1));
-		#if   DRAW_SOLID
-		glutSolidSphere(gTable.balls[i].radius,32,32);
-		#else
-		glutWireSphere(gTable.balls[i].radius,12,12);
-		#endif
-		glPopMatrix();
-		glColor3f(0.0,0.0,1.0);
+		vec4 centre((float)gTable.balls[i].position(0),(BALL_RADIUS/2.0f),(float)gTable.balls[i].position(1));
+		if(!gFrustum.SphereVisible(centre, gTable.balls[i].radius)) continue;
+		gRenderQueue.Sphere(LAYER_SCENE, centre, gTable.balls[i].radius, (i==0) ? white : blue);
 	}
-	glColor3f(1.0,1.0,1.0);
 
-	//draw the table
-	glPushMatrix();
-	
+	//the table
 	for(int i=0;i<NUM_CUSHION;i++){
-		glBegin(GL_LINE_LOOP);
 		vec2 cushion_start = gTable.cushions[i].start;
 		vec2 cushion_end = gTable.cushions[i].end;
-		glVertex3f(cushion_start.elem[0], 0.0, cushion_start.elem[1]);
-		glVertex3f(cushion_start.elem[0], 0.1, cushion_start.elem[1]);
-		glVertex3f(cushion_end.elem[0], 0.1, cushion_end.elem[1]);
-		glVertex3f(cushion_end.elem[0], 0.0, cushion_end.elem[1]);
-		glEnd();
+		vec4 corner[4] = {
+			vec4((float)cushion_start.elem[0], 0.0f, (float)cushion_start.elem[1]),
+			vec4((float)cushion_start.elem[0], CUSHION_HEIGHT, (float)cushion_start.elem[1]),
+			vec4((float)cushion_end.elem[0], CUSHION_HEIGHT, (float)cushion_end.elem[1]),
+			vec4((float)cushion_end.elem[0], 0.0f, (float)cushion_end.elem[1])};
+		for(int k=0;k<4;k++) gRenderQueue.Line(LAYER_SCENE, corner[k], corner[(k+1)%4], white);
 	}
 
-	//draw the cue
+	//the cue
 	if(gDoCue)
 	{
-		glBegin(GL_LINES);
 		float cuex = sin(gCueAngle) * gCuePower;
 		float cuez = cos(gCueAngle) * gCuePower;
-		glColor3f(1.0,0.0,0.0);
-		glVertex3f (gTable.balls[0].position(0), (BALL_RADIUS/2.0f), gTable.balls[0].position(1));
-		glVertex3f ((gTable.balls[0].position(0)+cuex), (BALL_RADIUS/2.0f), (gTable.balls[0].position(1)+cuez));
-		glColor3f(1.0,1.0,1.0);
-		glEnd();
+		vec4 cueBall((float)gTable.balls[0].position(0), (BALL_RADIUS/2.0f), (float)gTable.balls[0].position(1));
+		gRenderQueue.Line(LAYER_SCENE, cueBall, cueBall + vec4(cuex, 0.0f, cuez), red);
+
+		//the predicted paths
+		const aimPath &aim = gAimPreview.Get(gTable, gCueAngle, gCuePower, gCueBallFactor);
+		for(int i=1;i<aim.numCuePoints;i++)
+			gRenderQueue.Line(LAYER_OVERLAY, vec4((float)aim.cuePoints[i-1](0), (BALL_RADIUS/2.0f), (float)aim.cuePoints[i-1](1)),
+				vec4((float)aim.cuePoints[i](0), (BALL_RADIUS/2.0f), (float)aim.cuePoints[i](1)), RENDER_RGB(255,255,0));
+		if(aim.objectBall>=0)
+			gRenderQueue.Line(LAYER_OVERLAY, vec4((float)aim.objectPoints[0](0), (BALL_RADIUS/2.0f), (float)aim.objectPoints[0](1)),
+				vec4((float)aim.objectPoints[1](0), (BALL_RADIUS/2.0f), (float)aim.objectPoints[1](1)), RENDER_RGB(0,255,0));
 	}
 
-	glPopMatrix();
+	gRenderQueue.Submit();
 
 	glFlush();
+}
+
+typedef std::chrono::high_resolution_clock frameClock;
+
+static float MillisecondsSince(frameClock::time_point t)
+{
+	return std::chrono::duration<float, std::milli>(frameClock::now() - t).count();
+}
+
+//a frame up to the buffer swap, which --alloc-check runs offscreen.
+//The HUD goes on after the capture, so recorded clips are clean
+void RenderFrame(void) {
+	static frameClock::time_point lastFrame = frameClock::now();
+	float frameMs = MillisecondsSince(lastFrame);
+	lastFrame = frameClock::now();
+
+	{
+		ALLOC_TAG("draw");
+		DrawScene();
+	}
+	ALLOC_TAG("hud");
+	gHud.Frame(frameMs, MillisecondsSince(lastFrame), gParticleSetMgr->LiveParticleSets(), gParticleSetMgr->LiveParticles());
+	{
+		ALLOC_TAG("capture");
+		gCapture.Capture();
+	}
+	gHud.Draw(gWindowWidth, gWindowHeight);
+}
+
+void RenderScene(void) {
+	RenderFrame();
 	glutSwapBuffers();
 }
 
@@ -265,16 +286,13 @@ void KeyboardFunc(unsigned char key, int x, int y)
 			{
 				vec2 imp(	(-sin(gCueAngle) * gCuePower * gCueBallFactor),
 							(-cos(gCueAngle) * gCuePower * gCueBallFactor));
-				gTable.balls[0].ApplyImpulse(imp);				
+				gTable.ApplyImpulse(0,imp);
 			}
 			break;
 		}
 	case(27):
 		{
-			for(int i=0;i<NUM_BALLS;i++)
-			{
-				gTable.balls[i].Reset();
-			}
+			gTable.Reset();
 			break;
 		}
 	case(32):
@@ -312,6 +330,11 @@ void KeyboardFunc(unsigned char key, int x, int y)
 			gCamZout = true;
 			break;
 		}
+	case('h'):
+		{
+			gHud.Toggle();
+			break;
+		}
 	}
 
 }
@@ -364,6 +387,10 @@ void ChangeSize(int w, int h) {
 	// (you cant make a window of zero width).
 	if(h == 0) h = 1;
 	float ratio = 1.0* w / h;
+	gWindowWidth = w;
+	gWindowHeight = h;
+	//recording follows the window, not the size it was opened at
+	gCapture.Resize(w, h);
 
 	// Reset the coordinate system before modifying
 	glMatrixMode(GL_PROJECTION);
@@ -372,7 +399,8 @@ void ChangeSize(int w, int h) {
 	glViewport(0, 0, w, h);
 
 	// Set the correct perspective.
-	gluPerspective(45,ratio,0.2,1000);
+	gluPerspective(CAM_FOVY,ratio,CAM_NEAR,CAM_FAR);
+	gFrustum.SetPerspective(CAM_FOVY, ratio, CAM_NEAR, CAM_FAR);
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	//gluLookAt(0.0,0.7,2.1, 0.0,0.0,0.0, 0.0f,1.0f,0.0f);
@@ -399,6 +427,27 @@ void InitLights(void)
 	glEnable(GL_DEPTH_TEST);
 }
 
+//one simulation step : table, the fireworks from its hits, particles
+void StepScene(int ms)
+{
+	frameClock::time_point start = frameClock::now();
+	{
+		ALLOC_TAG("table");
+		gTable.Update(ms);
+	}
+	float tableMs = MillisecondsSince(start);
+
+	start = frameClock::now();
+	{
+		ALLOC_TAG("particles");
+		gParticleSetMgr->Fireworks(gTable.Events(), gTable.NumEvents());
+		gParticleSetMgr->Update(ms, gTable);
+	}
+	gHud.Step(tableMs, MillisecondsSince(start), gTable.NumEvents());
+	ALLOC_TAG("publish");
+	gPublisher.Publish(gTable, gParticleSetMgr->LiveParticles());
+}
+
 void UpdateScene(int ms) 
 {
 	if(gTable.AnyBallsMoving()==false) gDoCue = true;
@@ -419,20 +468,336 @@ void UpdateScene(int ms)
 
 	DoCamera(ms);
 
-	gTable.Update(ms);
-	gParticleSetMgr->Update(ms);
+	//time between updates, so it includes rendering : particles back
+	//off when it runs over
+	static int lastUpdate = 0;
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	if(lastUpdate) gParticleSetMgr->FrameTime((float)(now - lastUpdate));
+	lastUpdate = now;
+
+	StepScene(ms);
 
 	glutTimerFunc(SIM_UPDATE_MS, UpdateScene, SIM_UPDATE_MS);
 	glutPostRedisplay();
 }
 
 
+//command line helpers for the console modes
+static int ArgInt(int argc, _TCHAR* argv[], int i, int def)
+{
+	return (i<argc) ? _ttoi(argv[i]) : def;
+}
+
+static const char *ArgString(int argc, _TCHAR* argv[], int i, const char *def)
+{
+	if(i>=argc) return def;
+#ifdef _UNICODE
+	static char buffer[256];
+	wcstombs(buffer, argv[i], sizeof(buffer)-1);
+	buffer[sizeof(buffer)-1] = 0;
+	return buffer;
+#else
+	return argv[i];
+#endif
+}
+
+/*-----------------------------------------------------------
+  headless mode
+  Draws the scene offscreen as fast as it will go, for a
+  scripted camera and shot. For each frame it reports the
+  render thread's CPU time in DrawScene, and the wall time of
+  DrawScene and of the glFinish after it. glFinish waits for
+  the (software) rasteriser, whose own threads do the work,
+  so only wall time means anything there. One simulation
+  step per frame, so runs are repeatable.
+  -----------------------------------------------------------*/
+#define HEADLESS_ORBIT_FRAMES	(600)	//frames per turn of the camera
+#define HEADLESS_NEAR			(0.5f)	//closest and furthest camera distance, m
+#define HEADLESS_FAR			(2.5f)
+
+//CPU time used by the calling thread, in ms : time it spent preempted
+//or blocked is left out. Windows only counts it in scheduler ticks, so
+//per frame figures there are coarse
+static double ThreadCpuMs(void)
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart)/10000.0;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+#endif
+}
+
+static double Percentile(std::vector<double> &v, double p)
+{
+	if(v.empty()) return 0.0;
+	size_t i = (size_t)(p*(v.size()-1));
+	std::nth_element(v.begin(), v.begin()+i, v.end());
+	return v[i];
+}
+
+//the camera circles the table, moving in and out, so culling and the
+//amount drawn both vary
+static void HeadlessCamera(int frame)
+{
+	float turn = (TWO_PI*frame)/HEADLESS_ORBIT_FRAMES;
+	float dist = HEADLESS_NEAR + (HEADLESS_FAR - HEADLESS_NEAR)*0.5f*(1.0f + cosf(turn*2.0f));
+	gCamPos = vec4(sinf(turn)*dist, 0.35f*dist, cosf(turn)*dist);
+	gCamLookAt = vec4(0.0f,0.0f,0.0f);
+}
+
+//the same break, hit again whenever the table comes to rest
+static const float gHeadlessShots[] = {0.0f, 0.05f, -0.08f, 0.12f};
+#define HEADLESS_NUM_SHOTS	((int)(sizeof(gHeadlessShots)/sizeof(gHeadlessShots[0])))
+
+static void HeadlessShot(int &shot)
+{
+	if(gTable.AnyBallsMoving()) return;
+	gTable.Reset();
+	float angle = gHeadlessShots[(shot++)%HEADLESS_NUM_SHOTS];
+	gTable.ApplyImpulse(0, vec2(-sin(angle)*gCuePowerMax*gCueBallFactor, -cos(angle)*gCuePowerMax*gCueBallFactor));
+}
+
+static captureFormat CaptureFormat(const char *name)
+{
+	return (name && strcmp(name, "yuv")==0) ? CAPTURE_YUV : CAPTURE_PNG;
+}
+
+//glut exits from inside its main loop, after the window has gone
+static void CloseCapture(void)
+{
+	gCapture.Close(false);
+}
+
+int RunHeadless(int frames, int width, int height, const char *csvPath, const char *captureDir, captureFormat format, bool hud)
+{
+	offscreenContext offscreen;
+	if(!offscreen.Create(width, height))
+	{
+		printf("headless : %s\n", offscreen.Description());
+		return 1;
+	}
+	printf("headless : %s, %d frames\n", offscreen.Description(), frames);
+	ChangeSize(width, height);
+	#if DRAW_SOLID
+	InitLights();
+	#endif
+	glEnable(GL_DEPTH_TEST);
+
+	if(captureDir) gCapture.Open(captureDir, format, width, height);
+	FILE *csv = csvPath ? fopen(csvPath, "w") : 0;
+	if(csv) fprintf(csv, "frame,draw_cpu_ms,draw_wall_ms,finish_wall_ms,particles\n");
+
+	int shot = 0;
+
+	//wall time; the steady clock, as the high resolution one may be
+	//the adjustable system clock
+	typedef std::chrono::steady_clock clock;
+	std::vector<double> drawCpu, draw, total;
+	std::vector<double> hudMs;
+	double items = 0.0, drawCalls = 0.0, stateChanges = 0.0;
+	if(hud)
+	{
+		gHud.Toggle();
+		hudMs.reserve(frames);
+	}
+	drawCpu.reserve(frames);
+	draw.reserve(frames);
+	total.reserve(frames);
+	clock::time_point begin = clock::now();
+	for(int f=0;f<frames;f++)
+	{
+		HeadlessShot(shot);
+		StepScene(SIM_UPDATE_MS);
+		HeadlessCamera(f);
+
+		double cpuStart = ThreadCpuMs();
+		clock::time_point start = clock::now();
+		DrawScene();
+		clock::time_point submitted = clock::now();
+		double cpuMs = ThreadCpuMs() - cpuStart;
+		glFinish();
+		clock::time_point finished = clock::now();
+		double drawMs = std::chrono::duration<double, std::milli>(submitted - start).count();
+		double totalMs = std::chrono::duration<double, std::milli>(finished - start).count();
+		gHud.Frame((float)totalMs, (float)drawMs, gParticleSetMgr->LiveParticleSets(), gParticleSetMgr->LiveParticles());
+		gCapture.Capture();
+		if(hud)
+		{
+			clock::time_point overlay = clock::now();
+			gHud.Draw(width, height);
+			hudMs.push_back(std::chrono::duration<double, std::milli>(clock::now() - overlay).count());
+		}
+		items += gRenderQueue.Items();
+		drawCalls += gRenderQueue.DrawCalls();
+		stateChanges += gRenderQueue.StateChanges();
+		drawCpu.push_back(cpuMs);
+		draw.push_back(drawMs);
+		total.push_back(totalMs);
+		if(csv) fprintf(csv, "%d,%.4f,%.4f,%.4f,%d\n", f, cpuMs, drawMs, totalMs - drawMs, gParticleSetMgr->LiveParticles());
+	}
+	double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+	if(csv) fclose(csv);
+	gCapture.Close();
+
+	printf("  %.1f frames/s (simulation included)\n", frames/seconds);
+	printf("  draw, thread cpu : p50 %.3f ms, p95 %.3f ms, max %.3f ms\n", Percentile(drawCpu, 0.5), Percentile(drawCpu, 0.95), Percentile(drawCpu, 1.0));
+	printf("  draw, wall       : p50 %.3f ms, p95 %.3f ms, max %.3f ms\n", Percentile(draw, 0.5), Percentile(draw, 0.95), Percentile(draw, 1.0));
+	printf("  +finish, wall    : p50 %.3f ms, p95 %.3f ms, max %.3f ms\n", Percentile(total, 0.5), Percentile(total, 0.95), Percentile(total, 1.0));
+	printf("  per frame : %.1f items, %.1f draw calls, %.1f state changes\n", items/frames, drawCalls/frames, stateChanges/frames);
+	if(hud) printf("  hud, wall        : p50 %.3f ms, p95 %.3f ms, max %.3f ms\n", Percentile(hudMs, 0.5), Percentile(hudMs, 0.95), Percentile(hudMs, 1.0));
+	printf("  peak particles %d, %d shots\n", gParticleSetMgr->PeakParticles(), shot);
+	return 0;
+}
+
+/*-----------------------------------------------------------
+  allocation check
+  Plays the headless shots with the HUD on and fails if a
+  simulation step or a frame allocates once warmed up. The
+  particle colliders reserve their worst case up front and
+  the solver's pair and event buffers a busy step's worth,
+  so warming up is not relied on to find the busiest frame.
+  The fireworks are seeded and their quality held, so every
+  run plays the same frames and a failure repeats. Without
+  an offscreen context only the steps are checked.
+  -----------------------------------------------------------*/
+#define ALLOC_CHECK_WIDTH		(320)
+#define ALLOC_CHECK_HEIGHT		(240)
+#define ALLOC_CHECK_REPORTS		(10)	//offending frames printed
+#define ALLOC_CHECK_SEED		(1)		//for the fireworks' rand()
+
+//true if nothing was allocated since before
+static bool CheckAllocations(const char *what, int frame, uint64_t before, uint64_t bytesBefore, bool report)
+{
+	uint64_t n = ThreadAllocationCount() - before;
+	if(n==0) return true;
+	if(report)
+	{
+		const char *tag = ThreadLastAllocationTag();
+		printf("  frame %d : %s made %llu allocations, %llu bytes, the last in '%s'\n", frame, what,
+			(unsigned long long)n, (unsigned long long)(ThreadAllocationBytes() - bytesBefore), tag ? tag : "untagged");
+	}
+	return false;
+}
+
+int RunAllocationCheck(int frames)
+{
+	offscreenContext offscreen;
+	bool render = offscreen.Create(ALLOC_CHECK_WIDTH, ALLOC_CHECK_HEIGHT);
+	if(render)
+	{
+		printf("alloc check : %s, %d frames after warming up\n", offscreen.Description(), frames);
+		ChangeSize(ALLOC_CHECK_WIDTH, ALLOC_CHECK_HEIGHT);
+		#if DRAW_SOLID
+		InitLights();
+		#endif
+		glEnable(GL_DEPTH_TEST);
+		gHud.Toggle();
+	}
+	else printf("alloc check : %s, %d steps of the simulation only\n", offscreen.Description(), frames);
+
+	//the same fireworks every run, whatever the frame times
+	srand(ALLOC_CHECK_SEED);
+	gParticleSetMgr->HoldQuality(true, 1.0f);
+
+	int shot = 0, checked = 0, failures = 0, f = 0;
+	for(;checked<frames;f++)
+	{
+		HeadlessShot(shot);
+		bool warm = (shot>HEADLESS_NUM_SHOTS);
+
+		bool report = warm && failures<ALLOC_CHECK_REPORTS;
+		uint64_t before = ThreadAllocationCount(), bytes = ThreadAllocationBytes();
+		StepScene(SIM_UPDATE_MS);
+		bool clean = CheckAllocations("StepScene", f, before, bytes, report);
+
+		if(render)
+		{
+			HeadlessCamera(f);
+			before = ThreadAllocationCount();
+			bytes = ThreadAllocationBytes();
+			RenderFrame();
+			clean = CheckAllocations("RenderFrame", f, before, bytes, report) && clean;
+		}
+		if(!warm) continue;
+		checked++;
+		if(!clean) failures++;
+	}
+
+	//where the allocations went, warm up included
+	const char *names[ALLOC_TAGS];
+	uint64_t counts[ALLOC_TAGS];
+	int numTags = AllocationTags(names, counts, ALLOC_TAGS);
+	gParticleSetMgr->HoldQuality(false);
+	printf("  %d frames, %d shots, peak particles %d; allocations by tag :", f, shot, gParticleSetMgr->PeakParticles());
+	for(int i=0;i<numTags;i++) printf(" %s %llu", names[i], (unsigned long long)counts[i]);
+	printf("\n");
+	if(failures)
+	{
+		printf("FAILED : %d of %d frames allocated after warming up\n", failures, frames);
+		return 1;
+	}
+	printf("passed : no allocations in %d frames after warming up\n", frames);
+	return 0;
+}
+
 int _tmain(int argc, _TCHAR* argv[])
 {
+	//POOL_METRICS=path, in any mode : write the hot path counters there
+	//for node-exporter's textfile collector, every METRICS_INTERVAL_MS
+	const char *metricsPath = getenv(METRICS_ENV);
+	if(metricsPath && metricsPath[0] && !gMetrics.Start(metricsPath)) printf("could not write metrics to %s\n", metricsPath);
+
+	//console modes
+	if(argc>1 && _tcscmp(argv[1],_T("--bench-snapshot"))==0) return RunSnapshotBenchmark();
+	//--host [tables] [threads] [socket path]
+	if(argc>1 && _tcscmp(argv[1],_T("--host"))==0)
+		return RunHost(ArgInt(argc,argv,2,1000), ArgInt(argc,argv,3,0), ArgString(argc,argv,4,HOST_SOCKET_PATH));
+	//--loadgen [tables] [clients] [seconds] [threads]
+	if(argc>1 && _tcscmp(argv[1],_T("--loadgen"))==0)
+		return RunLoadGenerator(ArgInt(argc,argv,2,2000), ArgInt(argc,argv,3,2000), ArgInt(argc,argv,4,10), ArgInt(argc,argv,5,0));
+	//--bench-vecenv [envs] [threads] [seconds]
+	if(argc>1 && _tcscmp(argv[1],_T("--bench-vecenv"))==0)
+		return RunVecEnvBenchmark(ArgInt(argc,argv,2,4096), ArgInt(argc,argv,3,0), ArgInt(argc,argv,4,5));
+	//--fixed-check : hashes of the fixed point solver, to compare machines
+	if(argc>1 && _tcscmp(argv[1],_T("--fixed-check"))==0) return RunFixedCheck();
+	//--follow [name] : print the state published by a running game
+	if(argc>1 && _tcscmp(argv[1],_T("--follow"))==0) return RunFollower(ArgString(argc,argv,2,PUBLISH_NAME));
+	//--headless [frames] [width] [height] [csv path] [capture dir] [png|yuv] [hud] : render benchmark
+	//with no window; '-' skips the csv and capture, hud 1 draws the overlay and times it
+	if(argc>1 && _tcscmp(argv[1],_T("--headless"))==0)
+	{
+		//ArgString shares one buffer, so copy the earlier strings out
+		char csvPath[256] = "", captureDir[256] = "";
+		if(argc>5) strncpy(csvPath, ArgString(argc,argv,5,""), sizeof(csvPath)-1);
+		if(argc>6) strncpy(captureDir, ArgString(argc,argv,6,""), sizeof(captureDir)-1);
+		return RunHeadless(ArgInt(argc,argv,2,2000), ArgInt(argc,argv,3,WINDOW_WIDTH), ArgInt(argc,argv,4,WINDOW_HEIGHT),
+			(csvPath[0] && strcmp(csvPath, "-")!=0) ? csvPath : 0, (captureDir[0] && strcmp(captureDir, "-")!=0) ? captureDir : 0, CaptureFormat(ArgString(argc,argv,7,"png")),
+			ArgInt(argc,argv,8,0)!=0);
+	}
+
+	//--alloc-check [frames] : fail if a step or frame allocates once warmed up
+	if(argc>1 && _tcscmp(argv[1],_T("--alloc-check"))==0) return RunAllocationCheck(ArgInt(argc,argv,2,3000));
+
+	//--publish [name] [replace] : play, and publish every step to shared memory.
+	//replace 1 takes the name over from a publisher that crashed
+	if(argc>1 && _tcscmp(argv[1],_T("--publish"))==0)
+	{
+		const char *name = ArgString(argc,argv,2,PUBLISH_NAME);
+		if(!gPublisher.Open(gTable.NumBalls(), name, ArgInt(argc,argv,3,0)!=0))
+			printf("could not publish to %s : is another game publishing there? (replace with --publish %s 1)\n", name, name);
+	}
+
 	glutInit(&argc, ((char **)argv));
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE| GLUT_RGBA);
 	glutInitWindowPosition(0,0);
-	glutInitWindowSize(1000,700);
+	glutInitWindowSize(WINDOW_WIDTH,WINDOW_HEIGHT);
 	//glutFullScreen();
 	glutCreateWindow("MSc Workshop : Pool Game");
 	#if DRAW_SOLID
@@ -449,5 +814,13 @@ int _tmain(int argc, _TCHAR* argv[])
 	glutSpecialFunc(SpecKeyboardFunc);
 	glutSpecialUpFunc(SpecKeyboardUpFunc);
 	glEnable(GL_DEPTH_TEST);
+
+	//--capture [dir] [png|yuv] : play, and record every frame
+	if(argc>1 && _tcscmp(argv[1],_T("--capture"))==0)
+	{
+		char captureDir[256] = "";
+		strncpy(captureDir, ArgString(argc,argv,2,"."), sizeof(captureDir)-1);
+		if(gCapture.Open(captureDir, CaptureFormat(ArgString(argc,argv,3,"png")), WINDOW_WIDTH, WINDOW_HEIGHT)) atexit(CloseCapture);
+	}
 	glutMainLoop();
 }
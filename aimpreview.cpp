@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------
+  Aim Preview Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"aimpreview.h"
+#include"prediction.h"
+
+/*-----------------------------------------------------------
+  aimPreview class members
+  -----------------------------------------------------------*/
+aimPreview::aimPreview():hits(0),misses(0)
+{
+	for(int i=0;i<AIM_CACHE_SIZE;i++) cache[i].valid = false;
+}
+
+const aimPath &aimPreview::Get(const table &t, float angle, float power, float ballFactor)
+{
+	int angleKey = (int)floor((angle/AIM_ANGLE_STEP) + 0.5f);
+	int powerKey = (int)floor((power/AIM_POWER_STEP) + 0.5f);
+
+	entry &e = cache[((unsigned int)(angleKey*31 + powerKey)) & (AIM_CACHE_SIZE-1)];
+	if(e.valid && e.angleKey==angleKey && e.powerKey==powerKey && e.version==t.Version())
+	{
+		hits++;
+		return e.path;
+	}
+
+	misses++;
+	e.valid = true;
+	e.angleKey = angleKey;
+	e.powerKey = powerKey;
+	e.version = t.Version();
+	Compute(t, angleKey*AIM_ANGLE_STEP, powerKey*AIM_POWER_STEP, ballFactor, e.path);
+	return e.path;
+}
+
+void aimPreview::Compute(const table &t, float angle, float power, float ballFactor, aimPath &path)
+{
+	//work on a copy so the resolved collisions don't touch the real table
+	scratch = t;
+	ball &cue = scratch.balls[0];
+	//same impulse as the enter key applies
+	vec2 v((-sin(angle) * power * ballFactor), (-cos(angle) * power * ballFactor));
+
+	path.numCuePoints = 0;
+	path.objectBall = -1;
+	path.cuePoints[path.numCuePoints++] = cue.position;
+
+	for(int bounce=0;bounce<=AIM_MAX_CUSHIONS;bounce++)
+	{
+		ballPrediction pr;
+		PredictBall(scratch, 0, v, pr);
+		if(pr.contactType==CONTACT_NONE)
+		{
+			path.cuePoints[path.numCuePoints++] = pr.restPos;
+			return;
+		}
+		path.cuePoints[path.numCuePoints++] = pr.contactPos;
+		cue.position = pr.contactPos;
+		cue.velocity = pr.contactVelocity;
+
+		if(pr.contactType==CONTACT_CUSHION)
+		{
+			cue.HitPlane(scratch.cushions[pr.contactIndex]);
+			v = cue.velocity;
+			continue;
+		}
+
+		//first object ball : resolve the impact and follow both balls
+		//to their next stop or contact
+		ball &obj = scratch.balls[pr.contactIndex];
+		cue.HitBall(obj);
+		path.objectBall = pr.contactIndex;
+		ballPrediction op;
+		PredictBall(scratch, pr.contactIndex, obj.velocity, op);
+		path.objectPoints[0] = obj.position;
+		path.objectPoints[1] = (op.contactType==CONTACT_NONE) ? op.restPos : op.contactPos;
+
+		ballPrediction cp;
+		PredictBall(scratch, 0, cue.velocity, cp);
+		path.cuePoints[path.numCuePoints++] = (cp.contactType==CONTACT_NONE) ? cp.restPos : cp.contactPos;
+		return;
+	}
+}
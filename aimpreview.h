@@ -0,0 +1,64 @@
+/*-----------------------------------------------------------
+  Aim Preview Header File
+  Predicted path of the cue ball, and of the first object
+  ball it hits, for the shot currently being lined up.
+  -----------------------------------------------------------*/
+#ifndef aimpreview_h_included
+#define aimpreview_h_included
+
+#include"simulation.h"
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define AIM_MAX_CUSHIONS	(3)			//cushion bounces followed before giving up
+#define AIM_MAX_POINTS		(AIM_MAX_CUSHIONS+3)
+#define AIM_CACHE_SIZE		(64)		//must be a power of two
+#define AIM_ANGLE_STEP		(0.002f)	//radians
+#define AIM_POWER_STEP		(0.005f)
+
+/*-----------------------------------------------------------
+  aimPath : polylines on the table plane (x,z)
+  -----------------------------------------------------------*/
+struct aimPath
+{
+	int		numCuePoints;
+	vec2	cuePoints[AIM_MAX_POINTS];
+	int		objectBall;				//-1 if the cue ball hits no ball
+	vec2	objectPoints[2];
+};
+
+/*-----------------------------------------------------------
+  aimPreview class
+  Paths are worked out with the closed form prediction on a
+  scratch copy of the table, kept so copying into it reuses
+  its storage, for the angle and power rounded
+  to AIM_ANGLE_STEP and AIM_POWER_STEP, and cached against
+  those and the table's version so holding the cue keys only
+  costs a lookup most frames.
+  -----------------------------------------------------------*/
+class aimPreview
+{
+private:
+	struct entry
+	{
+		bool			valid;
+		int				angleKey;
+		int				powerKey;
+		unsigned int	version;
+		aimPath			path;
+	};
+	entry cache[AIM_CACHE_SIZE];
+	table scratch;
+
+	void Compute(const table &t, float angle, float power, float ballFactor, aimPath &path);
+
+public:
+	int hits;
+	int misses;
+
+	aimPreview();
+	const aimPath &Get(const table &t, float angle, float power, float ballFactor);
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*-----------------------------------------------------------
+  Allocation Tracking Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"alloctrack.h"
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+
+static std::atomic<uint64_t> gAllocations(0);
+
+//per thread : plain values, only their own thread touches them
+static thread_local uint64_t tAllocations = 0;
+static thread_local uint64_t tBytes = 0;
+static thread_local const char *tTag = 0;
+static thread_local const char *tLastTag = 0;
+
+//tags are told apart by pointer, a slot is claimed the first
+//time its tag allocates. Nothing here may allocate
+static std::atomic<const char *> gTagNames[ALLOC_TAGS];
+static std::atomic<uint64_t> gTagCounts[ALLOC_TAGS];
+
+uint64_t AllocationCount(void)
+{
+	return gAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t ThreadAllocationCount(void)
+{
+	return tAllocations;
+}
+
+uint64_t ThreadAllocationBytes(void)
+{
+	return tBytes;
+}
+
+const char *ThreadLastAllocationTag(void)
+{
+	return tLastTag;
+}
+
+static void CountTag(const char *name)
+{
+	for(int i=0;i<ALLOC_TAGS;i++)
+	{
+		const char *slot = gTagNames[i].load(std::memory_order_acquire);
+		if(!slot)
+		{
+			const char *empty = 0;
+			if(gTagNames[i].compare_exchange_strong(empty, name)) slot = name;
+			else slot = empty;
+		}
+		if(slot!=name) continue;
+		gTagCounts[i].fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+}
+
+int AllocationTags(const char **names, uint64_t *counts, int max)
+{
+	int n = 0;
+	for(int i=0;i<ALLOC_TAGS && n<max;i++)
+	{
+		const char *name = gTagNames[i].load(std::memory_order_acquire);
+		if(!name) break;
+		names[n] = name;
+		counts[n++] = gTagCounts[i].load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+/*-----------------------------------------------------------
+  allocTag class members
+  -----------------------------------------------------------*/
+allocTag::allocTag(const char *name):previous(tTag)
+{
+	tTag = name;
+}
+
+allocTag::~allocTag()
+{
+	tTag = previous;
+}
+
+/*-----------------------------------------------------------
+  global operator new and delete
+  -----------------------------------------------------------*/
+static void *Allocate(size_t n)
+{
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	tAllocations++;
+	tBytes += n;
+	tLastTag = tTag;
+	if(tTag) CountTag(tTag);
+	return malloc(n ? n : 1);
+}
+
+void *operator new(size_t n)
+{
+	void *p = Allocate(n);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t n)
+{
+	void *p = Allocate(n);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t n, const std::nothrow_t &) throw()
+{
+	return Allocate(n);
+}
+
+void *operator new[](size_t n, const std::nothrow_t &) throw()
+{
+	return Allocate(n);
+}
+
+void operator delete(void *p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+	free(p);
+}
+
+//sized forms : C++14 and VS2015 call these when the size is known.
+//replaced too, so every form frees with free whatever the library's
+//own versions forward to
+void operator delete(void *p, size_t) throw()
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) throw()
+{
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) throw()
+{
+	free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) throw()
+{
+	free(p);
+}
@@ -0,0 +1,50 @@
+/*-----------------------------------------------------------
+  Allocation Tracking Header File
+  The game replaces the global operator new and delete to
+  count heap allocations, so frames can report how many they
+  make and the allocation check can prove the steady state
+  makes none. Classes with VECMATH_ALIGNED_NEW allocate
+  through the global operator new, so they are counted too.
+  Counts are kept for the whole program and per thread, and
+  a call site can tag the allocations made inside it.
+  -----------------------------------------------------------*/
+#ifndef alloctrack_h_included
+#define alloctrack_h_included
+
+#include <stdint.h>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define ALLOC_TAGS		(32)	//distinct tags counted, later ones are not
+
+//allocations since the program started, all threads
+uint64_t AllocationCount(void);
+//this thread's allocations and the bytes they asked for
+uint64_t ThreadAllocationCount(void);
+uint64_t ThreadAllocationBytes(void);
+//the tag in scope at this thread's last allocation, 0 if none
+const char *ThreadLastAllocationTag(void);
+
+/*-----------------------------------------------------------
+  allocTag class
+  While one is in scope, the allocations its thread makes
+  are counted against its name, which must be a string
+  literal. Tags nest, the innermost wins.
+  -----------------------------------------------------------*/
+class allocTag
+{
+private:
+	const char *previous;
+
+public:
+	allocTag(const char *name);
+	~allocTag();
+};
+
+#define ALLOC_TAG(name)	allocTag allocTagScope(name)
+
+//the tags seen and their allocations, up to max; returns how many
+int AllocationTags(const char **names, uint64_t *counts, int max);
+
+#endif
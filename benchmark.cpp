@@ -0,0 +1,137 @@
+/*-----------------------------------------------------------
+  Benchmark Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"benchmark.h"
+#include"snapshot.h"
+#include <chrono>
+
+/*-----------------------------------------------------------
+  macros
+  -----------------------------------------------------------*/
+#define BENCH_BALL_WORK		(7000000)	//iterations times balls, per measurement
+#define BENCH_MIN_ITERATIONS	(200)
+
+static const int gBenchBallCounts[] = {7, 64, 1000, 100000};
+
+/*-----------------------------------------------------------
+  helpers
+  -----------------------------------------------------------*/
+typedef std::chrono::high_resolution_clock benchClock;
+
+static double NanosecondsPer(benchClock::time_point start, int iterations)
+{
+	std::chrono::duration<double, std::nano> d = benchClock::now() - start;
+	return d.count()/iterations;
+}
+
+//a table part way through a break, so some balls are moving
+static void SetUpTable(table &t)
+{
+	t.ApplyImpulse(0, vec2(-0.2, -5.0));
+	for(int i=0;i<20;i++) t.Update(SIM_UPDATE_MS);
+}
+
+/*-----------------------------------------------------------
+  benchmarks
+  -----------------------------------------------------------*/
+//one table size. A child is a fork of the parent with one ball
+//moved, as a search makes for each shot it tries : the flat
+//snapshot copies every ball for it, the cow one only the block
+//that changed
+static void SnapshotBenchmark(int numBalls, volatile double &sink)
+{
+	table t(numBalls);
+	SetUpTable(t);
+	int iterations = BENCH_BALL_WORK/numBalls;
+	if(iterations<BENCH_MIN_ITERATIONS) iterations = BENCH_MIN_ITERATIONS;
+	vec2 moved = t.balls[0].position;
+	vec2 velocity = t.balls[0].velocity;
+	vec2 nudge(0.001, 0.0);
+
+	double flatFork, flatChild, flatRestore;
+	double cowFork, cowChild, cowRestore;
+	size_t flatBytes, cowBytes;
+	double shared = 0.0;
+	int blocks;
+	{
+		tableSnapshot parent, child;
+		parent.Save(t);
+		benchClock::time_point start = benchClock::now();
+		for(int i=0;i<iterations;i++)
+		{
+			child = parent;
+			sink += child.Bytes();
+		}
+		flatFork = NanosecondsPer(start, iterations);
+
+		start = benchClock::now();
+		for(int i=0;i<iterations;i++)
+		{
+			t.SetBall(0, (i&1) ? moved+nudge : moved-nudge, velocity);
+			child.Save(t);
+		}
+		flatChild = NanosecondsPer(start, iterations);
+		flatBytes = child.Bytes();
+
+		start = benchClock::now();
+		for(int i=0;i<iterations;i++)
+		{
+			parent.Restore(t);
+			sink += t.balls[0].position(0);
+		}
+		flatRestore = NanosecondsPer(start, iterations);
+	}
+	{
+		cowSnapshot parent;
+		parent.Save(t);
+		benchClock::time_point start = benchClock::now();
+		for(int i=0;i<iterations;i++)
+		{
+			cowSnapshot child(parent);
+			sink += child.NumBlocks();
+		}
+		cowFork = NanosecondsPer(start, iterations);
+
+		cowSnapshot child(parent);
+		int sharedTotal = 0;
+		start = benchClock::now();
+		for(int i=0;i<iterations;i++)
+		{
+			t.SetBall(0, (i&1) ? moved+nudge : moved-nudge, velocity);
+			child.Save(t, &parent);
+			sharedTotal += child.SharedBlocks(parent);
+		}
+		cowChild = NanosecondsPer(start, iterations);
+		blocks = child.NumBlocks();
+		shared = (double)sharedTotal/iterations;
+		//what a child holds that its parent does not
+		cowBytes = (size_t)((blocks-shared)*sizeof(ballState)*SNAPSHOT_BLOCK_BALLS + 0.5) + sizeof(void *)*blocks + sizeof(int)*t.NumActive();
+
+		start = benchClock::now();
+		for(int i=0;i<iterations;i++)
+		{
+			parent.Restore(t);
+			sink += t.balls[0].position(0);
+		}
+		cowRestore = NanosecondsPer(start, iterations);
+	}
+	printf("%7d %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %10d %10d %7.1f/%d\n", numBalls,
+		flatFork, cowFork, flatChild, cowChild, flatRestore, cowRestore,
+		(int)flatBytes, (int)cowBytes, shared, blocks);
+}
+
+int RunSnapshotBenchmark(void)
+{
+	//keep the optimiser honest
+	volatile double sink = 0.0;
+
+	printf("snapshot benchmark, times in ns, a child is a fork with one ball moved\n");
+	printf("%7s %10s %10s %10s %10s %10s %10s %10s %10s %9s\n", "balls",
+		"flat fork", "cow fork", "flat child", "cow child", "flat rest", "cow rest",
+		"flat bytes", "cow bytes", "shared");
+	for(int i=0;i<(int)(sizeof(gBenchBallCounts)/sizeof(gBenchBallCounts[0]));i++)
+		SnapshotBenchmark(gBenchBallCounts[i], sink);
+	printf("checksum %g\n", (double)sink);
+	return 0;
+}
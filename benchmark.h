@@ -0,0 +1,12 @@
+/*-----------------------------------------------------------
+  Benchmark Header File
+  Console benchmarks, run from the command line instead of
+  opening the game window.
+  -----------------------------------------------------------*/
+#ifndef benchmark_h_included
+#define benchmark_h_included
+
+//fork, save and restore cost of table snapshots against ball count
+int RunSnapshotBenchmark(void);
+
+#endif
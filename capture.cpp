@@ -0,0 +1,442 @@
+/*-----------------------------------------------------------
+  Capture Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"capture.h"
+#include <string.h>
+#include <chrono>
+#ifndef _WIN32
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include<glut.h>
+
+/*-----------------------------------------------------------
+  buffer objects
+  GL 1.5/2.1 entry points : Windows' gl.h stops at 1.1, so
+  they are looked up there; elsewhere libGL exports them
+  -----------------------------------------------------------*/
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER	0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ			0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY			0x88B8
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+typedef void (APIENTRY *genBuffersProc)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *deleteBuffersProc)(GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY *bindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *bufferDataProc)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+typedef void *(APIENTRY *mapBufferProc)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *unmapBufferProc)(GLenum target);
+
+static genBuffersProc		genBuffers = 0;
+static deleteBuffersProc	deleteBuffers = 0;
+static bindBufferProc		bindBuffer = 0;
+static bufferDataProc		bufferData = 0;
+static mapBufferProc		mapBuffer = 0;
+static unmapBufferProc		unmapBuffer = 0;
+
+static bool LoadBufferProcs(void)
+{
+	if(genBuffers) return true;
+#ifdef _WIN32
+	genBuffers = (genBuffersProc)wglGetProcAddress("glGenBuffers");
+	deleteBuffers = (deleteBuffersProc)wglGetProcAddress("glDeleteBuffers");
+	bindBuffer = (bindBufferProc)wglGetProcAddress("glBindBuffer");
+	bufferData = (bufferDataProc)wglGetProcAddress("glBufferData");
+	mapBuffer = (mapBufferProc)wglGetProcAddress("glMapBuffer");
+	unmapBuffer = (unmapBufferProc)wglGetProcAddress("glUnmapBuffer");
+#else
+	genBuffers = (genBuffersProc)glGenBuffers;
+	deleteBuffers = (deleteBuffersProc)glDeleteBuffers;
+	bindBuffer = (bindBufferProc)glBindBuffer;
+	bufferData = (bufferDataProc)glBufferData;
+	mapBuffer = (mapBufferProc)glMapBuffer;
+	unmapBuffer = (unmapBufferProc)glUnmapBuffer;
+#endif
+	return genBuffers && deleteBuffers && bindBuffer && bufferData && mapBuffer && unmapBuffer;
+}
+
+/*-----------------------------------------------------------
+  png helpers
+  stored (uncompressed) deflate blocks : no zlib needed, the
+  files are big but quick to write
+  -----------------------------------------------------------*/
+static uint32_t Crc32(uint32_t crc, const unsigned char *p, size_t n)
+{
+	static uint32_t table[256];
+	static bool built = false;
+	if(!built)
+	{
+		for(uint32_t i=0;i<256;i++)
+		{
+			uint32_t c = i;
+			for(int k=0;k<8;k++) c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+			table[i] = c;
+		}
+		built = true;
+	}
+	crc = ~crc;
+	for(size_t i=0;i<n;i++) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void PutBE32(unsigned char *p, uint32_t x)
+{
+	p[0] = (unsigned char)(x >> 24);
+	p[1] = (unsigned char)(x >> 16);
+	p[2] = (unsigned char)(x >> 8);
+	p[3] = (unsigned char)x;
+}
+
+static void WriteChunk(FILE *f, const char *type, const unsigned char *data, uint32_t n)
+{
+	unsigned char head[8];
+	PutBE32(head, n);
+	memcpy(head+4, type, 4);
+	uint32_t crc = Crc32(0, head+4, 4);
+	crc = Crc32(crc, data, n);
+	unsigned char tail[4];
+	PutBE32(tail, crc);
+	fwrite(head, 1, 8, f);
+	fwrite(data, 1, n, f);
+	fwrite(tail, 1, 4, f);
+}
+
+/*-----------------------------------------------------------
+  frameCapture class members
+  -----------------------------------------------------------*/
+frameCapture::frameCapture():open(false),format(CAPTURE_PNG),width(0),height(0),yuvFile(0),yuvSegment(0),
+	frame(0),pending(false),numFree(0),readyHead(0),numReady(0),stopping(false),
+	written(0),dropped(0),captureMs(0.0),worstMs(0.0)
+{
+	dir[0] = 0;
+	yuvPath[0] = 0;
+	pbo[0] = pbo[1] = 0;
+}
+
+frameCapture::~frameCapture()
+{
+	Close();
+}
+
+bool frameCapture::Open(const char *directory, captureFormat f, int w, int h)
+{
+	Close();
+	if(!LoadBufferProcs())
+	{
+		printf("capture : no pixel buffer objects (needs OpenGL 2.1)\n");
+		return false;
+	}
+	strncpy(dir, directory, sizeof(dir)-1);
+	dir[sizeof(dir)-1] = 0;
+	format = f;
+	width = w;
+	height = h;
+	yuvSegment = 0;
+	if(format==CAPTURE_YUV && !OpenYuv(w, h)) return false;
+
+	genBuffers(2, pbo);
+	for(int i=0;i<CAPTURE_QUEUE;i++) freeSlots[i] = i;
+	numFree = CAPTURE_QUEUE;
+	Allocate();
+	readyHead = numReady = 0;
+	frame = 0;
+	pending = false;
+	written = 0;
+	dropped = 0;
+	captureMs = worstMs = 0.0;
+	stopping = false;
+	open = true;
+	encoder = std::thread(&frameCapture::EncoderLoop, this);
+	return true;
+}
+
+void frameCapture::Allocate(void)
+{
+	//the buffers and the free slots up front : the render thread only
+	//allocates when the window changes size. Slots the encoder has are
+	//resized on its thread as it hands them back
+	size_t frameBytes = (size_t)width*height*4;
+	for(int i=0;i<2;i++)
+	{
+		bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+		bufferData(GL_PIXEL_PACK_BUFFER, (ptrdiff_t)frameBytes, 0, GL_STREAM_READ);
+	}
+	bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	std::lock_guard<std::mutex> hold(lock);
+	for(int i=0;i<numFree;i++) slotPixels[freeSlots[i]].resize(frameBytes);
+}
+
+bool frameCapture::OpenYuv(int w, int h)
+{
+	yuvWidth = w;
+	yuvHeight = h;
+	if(yuvSegment==0) snprintf(yuvPath, sizeof(yuvPath), "%s/capture.yuv", dir);
+	else snprintf(yuvPath, sizeof(yuvPath), "%s/capture_%d.yuv", dir, yuvSegment);
+	yuvFile = fopen(yuvPath, "wb");
+	if(!yuvFile) printf("capture : could not open %s\n", yuvPath);
+	return yuvFile!=0;
+}
+
+void frameCapture::CloseYuv(void)
+{
+	if(!yuvFile) return;
+	fclose(yuvFile);
+	yuvFile = 0;
+	yuvSegment++;
+	printf("capture : %s is I420 %dx%d\n", yuvPath, yuvWidth&~1, yuvHeight&~1);
+}
+
+void frameCapture::CopyOut(void)
+{
+	pending = false;
+	//take a slot first, so a frame that will be dropped is never mapped
+	int slot = -1;
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		if(numFree>0) slot = freeSlots[--numFree];
+	}
+	if(slot<0)
+	{
+		dropped++;
+		return;
+	}
+
+	//frame-1 is the newest frame read; the map is held for the copy only
+	bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[(frame-1) & 1]);
+	const unsigned char *src = (const unsigned char *)mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if(src)
+	{
+		//only a slot handed back across two quick resizes is the wrong size
+		size_t bytes = (size_t)width*height*4;
+		if(slotPixels[slot].size()!=bytes) slotPixels[slot].resize(bytes);
+		memcpy(&slotPixels[slot][0], src, bytes);
+		unmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slotWidth[slot] = width;
+	slotHeight[slot] = height;
+	slotFrame[slot] = frame-1;
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		if(src) ready[(readyHead + numReady++) % CAPTURE_QUEUE] = slot;
+		else freeSlots[numFree++] = slot;
+	}
+	if(src) wake.notify_one();
+}
+
+void frameCapture::Resize(int w, int h)
+{
+	if(!open || (w==width && h==height)) return;
+	//the last read is the old size : queue it before the buffers go
+	if(pending) CopyOut();
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		width = w;
+		height = h;
+	}
+	Allocate();
+}
+
+void frameCapture::Capture(void)
+{
+	if(!open) return;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	//hand on the last frame, whose read has had a frame to finish, then
+	//start this one's : mapping before queueing the new read keeps the
+	//map from flushing it
+	if(pending) CopyOut();
+	bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frame & 1]);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	frame++;
+	pending = true;
+	bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	captureMs += ms;
+	if(ms>worstMs) worstMs = ms;
+}
+
+void frameCapture::Close(bool withContext)
+{
+	if(!open) return;
+	if(pending && withContext) CopyOut();
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	encoder.join();
+	if(withContext) deleteBuffers(2, pbo);
+	pbo[0] = pbo[1] = 0;
+	open = false;
+
+	printf("capture : %d frames, %d written, %d dropped, %.3f ms per frame on the render thread (worst %.3f)\n",
+		frame, (int)written, dropped, frame ? captureMs/frame : 0.0, worstMs);
+	CloseYuv();
+}
+
+void frameCapture::EncoderLoop(void)
+{
+	for(;;)
+	{
+		int slot;
+		{
+			std::unique_lock<std::mutex> hold(lock);
+			while(numReady==0 && !stopping) wake.wait(hold);
+			if(numReady==0) return;		//stopping, and nothing left
+			slot = ready[readyHead];
+			readyHead = (readyHead + 1) % CAPTURE_QUEUE;
+			numReady--;
+		}
+		const unsigned char *rgba = &slotPixels[slot][0];
+		int w = slotWidth[slot], h = slotHeight[slot];
+		bool ok;
+		if(format==CAPTURE_PNG) ok = WritePng(rgba, w, h, slotFrame[slot]);
+		else
+		{
+			//a raw stream can't change size part way, so start the next file
+			if(w!=yuvWidth || h!=yuvHeight)
+			{
+				CloseYuv();
+				OpenYuv(w, h);
+			}
+			ok = WriteYuv(rgba, w, h);
+		}
+		if(ok) written++;
+
+		//hand it back at the current size, so the render thread need
+		//not allocate for it
+		size_t bytes;
+		{
+			std::lock_guard<std::mutex> hold(lock);
+			bytes = (size_t)width*height*4;
+		}
+		if(slotPixels[slot].size()!=bytes) slotPixels[slot].resize(bytes);
+		{
+			std::lock_guard<std::mutex> hold(lock);
+			freeSlots[numFree++] = slot;
+		}
+	}
+}
+
+bool frameCapture::WritePng(const unsigned char *rgba, int frameWidth, int frameHeight, int n)
+{
+	char path[CAPTURE_PATH_MAX+32];
+	snprintf(path, sizeof(path), "%s/frame_%06d.png", dir, n);
+	FILE *f = fopen(path, "wb");
+	if(!f) return false;
+
+	//rows top down (GL reads bottom up), each after a filter byte
+	size_t rowBytes = (size_t)frameWidth*3 + 1;
+	size_t rawBytes = rowBytes*frameHeight;
+	scratch.resize(rawBytes);
+	for(int y=0;y<frameHeight;y++)
+	{
+		const unsigned char *src = rgba + (size_t)(frameHeight-1-y)*frameWidth*4;
+		unsigned char *row = &scratch[(size_t)y*rowBytes];
+		row[0] = 0;
+		for(int x=0;x<frameWidth;x++)
+		{
+			row[1+x*3] = src[x*4];
+			row[2+x*3] = src[x*4+1];
+			row[3+x*3] = src[x*4+2];
+		}
+	}
+
+	//adler32, reduced every 5552 bytes, the most that cannot overflow
+	uint32_t a = 1, b = 0;
+	for(size_t i=0;i<rawBytes;)
+	{
+		size_t end = (rawBytes - i > 5552) ? i + 5552 : rawBytes;
+		for(;i<end;i++) {a += scratch[i]; b += a;}
+		a %= 65521;
+		b %= 65521;
+	}
+
+	static const unsigned char signature[8] = {0x89,'P','N','G','\r','\n',0x1a,'\n'};
+	unsigned char header[13];
+	PutBE32(header, frameWidth);
+	PutBE32(header+4, frameHeight);
+	header[8] = 8;		//bits per channel
+	header[9] = 2;		//RGB
+	header[10] = header[11] = header[12] = 0;
+	fwrite(signature, 1, 8, f);
+	WriteChunk(f, "IHDR", header, 13);
+
+	//IDAT : zlib header, stored blocks of up to 65535 bytes, adler32
+	size_t numBlocks = (rawBytes + 65534)/65535;
+	unsigned char word[8];
+	PutBE32(word, (uint32_t)(2 + numBlocks*5 + rawBytes + 4));
+	memcpy(word+4, "IDAT", 4);
+	fwrite(word, 1, 8, f);
+	uint32_t crc = Crc32(0, word+4, 4);
+	static const unsigned char zlibHeader[2] = {0x78, 0x01};
+	fwrite(zlibHeader, 1, 2, f);
+	crc = Crc32(crc, zlibHeader, 2);
+	for(size_t i=0;i<rawBytes;i+=65535)
+	{
+		size_t len = (rawBytes - i > 65535) ? 65535 : rawBytes - i;
+		unsigned char block[5] = {(unsigned char)((i + len==rawBytes) ? 1 : 0),
+			(unsigned char)len, (unsigned char)(len >> 8), (unsigned char)~len, (unsigned char)(~len >> 8)};
+		fwrite(block, 1, 5, f);
+		fwrite(&scratch[i], 1, len, f);
+		crc = Crc32(crc, block, 5);
+		crc = Crc32(crc, &scratch[i], len);
+	}
+	PutBE32(word, (b << 16) | a);
+	fwrite(word, 1, 4, f);
+	crc = Crc32(crc, word, 4);
+	PutBE32(word, crc);
+	fwrite(word, 1, 4, f);
+
+	WriteChunk(f, "IEND", 0, 0);
+	bool ok = (ferror(f)==0);
+	fclose(f);
+	return ok;
+}
+
+bool frameCapture::WriteYuv(const unsigned char *rgba, int frameWidth, int frameHeight)
+{
+	//I420, BT.601 studio range; an odd last row or column is cut
+	if(!yuvFile) return false;
+	int w = frameWidth & ~1, h = frameHeight & ~1;
+	scratch.resize((size_t)w*h*3/2);
+	unsigned char *yPlane = &scratch[0];
+	unsigned char *uPlane = yPlane + (size_t)w*h;
+	unsigned char *vPlane = uPlane + (size_t)(w/2)*(h/2);
+	for(int y=0;y<h;y++)
+	{
+		const unsigned char *src = rgba + (size_t)(frameHeight-1-y)*frameWidth*4;
+		for(int x=0;x<w;x++)
+		{
+			int r = src[x*4], g = src[x*4+1], b = src[x*4+2];
+			yPlane[(size_t)y*w + x] = (unsigned char)(((66*r + 129*g + 25*b + 128) >> 8) + 16);
+		}
+	}
+	for(int y=0;y<h/2;y++)
+	{
+		const unsigned char *row0 = rgba + (size_t)(frameHeight-1-2*y)*frameWidth*4;
+		const unsigned char *row1 = row0 - (size_t)frameWidth*4;
+		for(int x=0;x<w/2;x++)
+		{
+			int r = 0, g = 0, b = 0;
+			const unsigned char *p[4] = {row0 + x*8, row0 + x*8 + 4, row1 + x*8, row1 + x*8 + 4};
+			for(int k=0;k<4;k++) {r += p[k][0]; g += p[k][1]; b += p[k][2];}
+			r = (r + 2)/4; g = (g + 2)/4; b = (b + 2)/4;
+			uPlane[(size_t)y*(w/2) + x] = (unsigned char)(((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+			vPlane[(size_t)y*(w/2) + x] = (unsigned char)(((112*r - 94*g - 18*b + 128) >> 8) + 128);
+		}
+	}
+	fwrite(yPlane, 1, scratch.size(), yuvFile);
+	return ferror(yuvFile)==0;
+}
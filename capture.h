@@ -0,0 +1,113 @@
+/*-----------------------------------------------------------
+  Capture Header File
+  Records the frames the game draws, for exporting clips.
+  The render thread only starts an asynchronous read of the
+  frame into one of two pixel buffer objects and copies out
+  the previous frame's, which has finished by then; a
+  background thread encodes it. Frames wait in a bounded
+  queue of preallocated slots : when the encoder falls
+  behind the frame is dropped and counted, the render thread
+  never waits for it. Close reports what the render thread
+  actually spent per frame; with a software GL the read is
+  synchronous and dominates it.
+  -----------------------------------------------------------*/
+#ifndef capture_h_included
+#define capture_h_included
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define CAPTURE_QUEUE		(8)		//frames waiting for the encoder
+#define CAPTURE_PATH_MAX	(256)
+
+enum captureFormat
+{
+	CAPTURE_PNG,	//dir/frame_000000.png ..., numbered by frame so drops leave gaps
+	CAPTURE_YUV,	//dir/capture.yuv, raw I420 frames back to back; each resize
+					//starts a new file, capture_1.yuv and so on
+};
+
+/*-----------------------------------------------------------
+  frameCapture class
+  Open and Capture need the GL context current; Capture goes
+  after the scene is drawn and before the buffer swap.
+  -----------------------------------------------------------*/
+class frameCapture
+{
+private:
+	bool			open;
+	captureFormat	format;
+	int				width;
+	int				height;
+	char			dir[CAPTURE_PATH_MAX];
+	FILE			*yuvFile;
+	int				yuvSegment;		//files finished, one per size
+	char			yuvPath[CAPTURE_PATH_MAX+32];
+	int				yuvWidth;		//the open file's frame size
+	int				yuvHeight;
+
+	//read back
+	unsigned int	pbo[2];
+	int				frame;			//frames captured so far
+	bool			pending;		//pbo[(frame-1)&1] holds a frame to copy out
+
+	//queue : slots are either free or waiting for the encoder. Each
+	//has its own size, so frames queued before a resize are still
+	//written at theirs
+	std::vector<unsigned char>	slotPixels[CAPTURE_QUEUE];	//RGBA
+	int				slotWidth[CAPTURE_QUEUE];
+	int				slotHeight[CAPTURE_QUEUE];
+	int				slotFrame[CAPTURE_QUEUE];
+	int				freeSlots[CAPTURE_QUEUE];
+	int				numFree;
+	int				ready[CAPTURE_QUEUE];	//ring, oldest first
+	int				readyHead;
+	int				numReady;
+	std::mutex		lock;
+	std::condition_variable	wake;
+	bool			stopping;
+	std::thread		encoder;
+
+	//encoder scratch, only touched on its thread
+	std::vector<unsigned char>	scratch;
+
+	//stats
+	std::atomic<int>	written;
+	int				dropped;
+	double			captureMs;		//render thread time, total
+	double			worstMs;
+
+	void CopyOut(void);
+	void Allocate(void);
+	bool OpenYuv(int w, int h);
+	void CloseYuv(void);
+	void EncoderLoop(void);
+	bool WritePng(const unsigned char *rgba, int w, int h, int n);
+	bool WriteYuv(const unsigned char *rgba, int w, int h);
+
+public:
+	frameCapture();
+	~frameCapture();
+
+	bool Open(const char *directory, captureFormat f, int w, int h);
+	//follow the window : call from the reshape callback. Never waits
+	//for the encoder : queued frames are written at their old size,
+	//and the slots come back at the new one
+	void Resize(int w, int h);
+	void Capture(void);
+	//finish encoding and print the stats; withContext false skips the
+	//GL calls (the last frame is lost), for when the context has gone
+	void Close(bool withContext = true);
+
+	bool IsOpen(void) const {return open;}
+	int Written(void) const {return written;}
+	int Dropped(void) const {return dropped;}
+};
+
+#endif
@@ -0,0 +1,286 @@
+/*-----------------------------------------------------------
+  Fixed Point Simulation Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"fixedsim.h"
+
+/*-----------------------------------------------------------
+  integer helpers
+  only operations whose results C++ defines exactly : no
+  shifts of negative numbers, division truncates to zero
+  -----------------------------------------------------------*/
+//n/d rounded half away from zero, d>0
+static int64_t DivRound(int64_t n, int64_t d)
+{
+	return (n>=0) ? ((n + d/2)/d) : -((-n + d/2)/d);
+}
+
+static fixed Mul(fixed a, fixed b)
+{
+	return (fixed)DivRound((int64_t)a*b, FIXED_ONE);
+}
+
+static uint64_t Square(fixed x, fixed z)
+{
+	return (uint64_t)((int64_t)x*x) + (uint64_t)((int64_t)z*z);
+}
+
+uint32_t ISqrt64(uint64_t x)
+{
+	//bit by bit : one result bit per iteration, from the top
+	uint64_t result = 0;
+	uint64_t bit = 1ULL << 62;
+	while(bit > x) bit >>= 2;
+	while(bit)
+	{
+		if(x >= result + bit)
+		{
+			x -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else result >>= 1;
+		bit >>= 2;
+	}
+	return (uint32_t)result;
+}
+
+static uint64_t Mix64(uint64_t x)
+{
+	//splitmix64 finaliser
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/*-----------------------------------------------------------
+  fixedTable class members
+  -----------------------------------------------------------*/
+fixedTable::fixedTable(const table &t):
+	balls(t.NumBalls()),activeList(t.NumBalls()),isActive(t.NumBalls(), 0),
+	activeCount(0),steps(0),hash(0),ballHash(t.NumBalls(), 0)
+{
+	const rectBounds &b = t.Bounds();
+	minX = FixedFromDouble(b.minX);
+	maxX = FixedFromDouble(b.maxX);
+	minZ = FixedFromDouble(b.minZ);
+	maxZ = FixedFromDouble(b.maxZ);
+	restitution = FixedFromDouble(gCoeffRestitution);
+	frictionDecel = FixedFromDouble(gCoeffFriction * gGravityAccn);
+	smallVelocity = FixedFromDouble(SMALL_VELOCITY);
+	maxTravel = FixedFromDouble(CCD_MAX_TRAVEL);
+
+	for(int i=0;i<NumBalls();i++)
+	{
+		const ball &src = t.balls[i];
+		fixedBall &f = balls[i];
+		f.px = FixedFromDouble(src.position(0));
+		f.pz = FixedFromDouble(src.position(1));
+		f.vx = FixedFromDouble(src.velocity(0));
+		f.vz = FixedFromDouble(src.velocity(1));
+		f.radius = FixedFromDouble(src.radius);
+		f.mass = FixedFromDouble(src.mass);
+		if(f.vx!=0 || f.vz!=0) Wake(i);
+		Rehash(i);
+	}
+}
+
+void fixedTable::Wake(int i)
+{
+	if(isActive[i]) return;
+	isActive[i] = 1;
+	activeList[activeCount++] = i;
+}
+
+void fixedTable::Rehash(int i)
+{
+	//the state is exact, so no quantising : any difference shows
+	const fixedBall &b = balls[i];
+	uint64_t key = Mix64(((uint64_t)i + 1)*0x9e3779b97f4a7c15ULL);
+	uint64_t h = Mix64(key ^ (((uint64_t)(uint32_t)b.px << 32) | (uint32_t)b.pz));
+	h ^= Mix64((key + 1) ^ (((uint64_t)(uint32_t)b.vx << 32) | (uint32_t)b.vz));
+	if(isActive[i]) h ^= key;
+	hash ^= ballHash[i] ^ h;
+	ballHash[i] = h;
+}
+
+void fixedTable::ApplyImpulse(int i, fixed vx, fixed vz)
+{
+	balls[i].vx = vx;
+	balls[i].vz = vz;
+	if(vx!=0 || vz!=0) Wake(i);
+	Rehash(i);
+}
+
+void fixedTable::Friction(fixedBall &b, int ms)
+{
+	//as ball::ApplyFrictionForce : take a fixed amount off the speed,
+	//keeping the direction
+	uint32_t speed = ISqrt64(Square(b.vx, b.vz));
+	if(speed==0) return;
+	int64_t change = DivRound((int64_t)frictionDecel*ms, 1000);
+	if(change >= (int64_t)speed)
+	{
+		b.vx = 0;
+		b.vz = 0;
+		return;
+	}
+	b.vx = (fixed)DivRound((int64_t)b.vx*((int64_t)speed - change), speed);
+	b.vz = (fixed)DivRound((int64_t)b.vz*((int64_t)speed - change), speed);
+}
+
+void fixedTable::HitBall(fixedBall &a, fixedBall &b)
+{
+	//as ball::HitBall : exchange the momentum along the line of centres
+	fixed dx = a.px - b.px;
+	fixed dz = a.pz - b.pz;
+	uint32_t dist = ISqrt64(Square(dx, dz));
+	fixed nx = FIXED_ONE, nz = 0;
+	if(dist>0)
+	{
+		nx = (fixed)DivRound((int64_t)dx*FIXED_ONE, dist);
+		nz = (fixed)DivRound((int64_t)dz*FIXED_ONE, dist);
+	}
+	fixed perpV = Mul(a.vx, nx) + Mul(a.vz, nz);
+	fixed perpV2 = Mul(b.vx, nx) + Mul(b.vz, nz);
+	int64_t sumMass = (int64_t)a.mass + b.mass;
+	fixed perpVNew = (fixed)DivRound((int64_t)perpV*(a.mass-b.mass) + (int64_t)perpV2*2*b.mass, sumMass);
+	fixed perpVNew2 = (fixed)DivRound((int64_t)perpV2*(b.mass-a.mass) + (int64_t)perpV*2*a.mass, sumMass);
+	a.vx += Mul(nx, perpVNew - perpV);
+	a.vz += Mul(nz, perpVNew - perpV);
+	b.vx += Mul(nx, perpVNew2 - perpV2);
+	b.vz += Mul(nz, perpVNew2 - perpV2);
+}
+
+void fixedTable::SubStep(int ms)
+{
+	//cushions, in the order of ball::DoRectPlaneCollisions
+	for(int k=0;k<activeCount;k++)
+	{
+		fixedBall &b = balls[activeList[k]];
+		if(b.vz > 0 && (maxZ - b.pz) <= b.radius) b.vz = -Mul(b.vz, restitution);
+		if(b.vx < 0 && (b.px - minX) <= b.radius) b.vx = -Mul(b.vx, restitution);
+		if(b.vz < 0 && (b.pz - minZ) <= b.radius) b.vz = -Mul(b.vz, restitution);
+		if(b.vx > 0 && (maxX - b.px) <= b.radius) b.vx = -Mul(b.vx, restitution);
+	}
+
+	//ball pairs, as table::Update : active pairs once from the lower
+	//index, sleeping balls only within reach of this sub-step's travel.
+	//hits are resolved as they are found, in the same order on any node
+	int numBalls = NumBalls();
+	int count = activeCount;
+	for(int k=0;k<count;k++)
+	{
+		int i = activeList[k];
+		fixedBall &a = balls[i];
+		int64_t sweep = DivRound((int64_t)ISqrt64(Square(a.vx, a.vz))*ms, 1000);
+		for(int j=0;j<numBalls;j++)
+		{
+			if(j==i) continue;
+			if(isActive[j] && j<i) continue;
+			fixedBall &b = balls[j];
+			fixed dx = a.px - b.px;
+			fixed dz = a.pz - b.pz;
+			uint64_t d2 = Square(dx, dz);
+			int64_t sumRadii = (int64_t)a.radius + b.radius;
+			if(!isActive[j])
+			{
+				int64_t reach = sumRadii + sweep;
+				if(d2 > (uint64_t)(reach*reach)) continue;
+			}
+			//touching and approaching
+			if(d2 > (uint64_t)(sumRadii*sumRadii)) continue;
+			if(((int64_t)(a.vx-b.vx)*dx + (int64_t)(a.vz-b.vz)*dz) >= 0) continue;
+			HitBall(a, b);
+			Wake(j);
+		}
+	}
+
+	//move, and put the balls that stopped to sleep
+	int64_t small2 = (int64_t)smallVelocity*smallVelocity;
+	for(int k=activeCount-1;k>=0;k--)
+	{
+		int i = activeList[k];
+		fixedBall &b = balls[i];
+		Friction(b, ms);
+		b.px += (fixed)DivRound((int64_t)b.vx*ms, 1000);
+		b.pz += (fixed)DivRound((int64_t)b.vz*ms, 1000);
+		if((int64_t)Square(b.vx, b.vz) < small2)
+		{
+			b.vx = 0;
+			b.vz = 0;
+		}
+		if(b.vx==0 && b.vz==0)
+		{
+			isActive[i] = 0;
+			activeList[k] = activeList[--activeCount];
+		}
+		Rehash(i);
+	}
+}
+
+void fixedTable::Update(int ms)
+{
+	if(activeCount==0) return;
+	steps++;
+
+	//the fastest ball sets the number of equal sub-steps
+	uint32_t fastest = 0;
+	for(int k=0;k<activeCount;k++)
+	{
+		const fixedBall &b = balls[activeList[k]];
+		uint32_t speed = ISqrt64(Square(b.vx, b.vz));
+		if(speed>fastest) fastest = speed;
+	}
+	int64_t travel = DivRound((int64_t)fastest*ms, 1000);
+	int subSteps = (int)((travel + maxTravel - 1)/maxTravel);
+	if(subSteps<1) subSteps = 1;
+	if(subSteps>ms) subSteps = ms;
+	for(int s=0;s<subSteps && activeCount>0;s++)
+		SubStep(((ms*(s+1))/subSteps) - ((ms*s)/subSteps));
+}
+
+void fixedTable::Store(table &t) const
+{
+	for(int i=0;i<NumBalls() && i<t.NumBalls();i++)
+	{
+		const fixedBall &b = balls[i];
+		t.SetBall(i, vec2(FixedToDouble(b.px), FixedToDouble(b.pz)), vec2(FixedToDouble(b.vx), FixedToDouble(b.vz)));
+	}
+}
+
+/*-----------------------------------------------------------
+  console mode
+  -----------------------------------------------------------*/
+int RunFixedCheck(void)
+{
+	//cue ball velocities in 16.16 m/s, the inputs a node would send
+	static const fixed shots[][2] = {
+		{0, -262144},			//4 m/s straight at the rack
+		{-6554, -393216},		//6 m/s, a little left
+		{52429, -196608},		//off the side cushion first
+		{0, -1966080},			//30 m/s
+		{-13107, 327680},		//away from the rack
+	};
+	int numShots = (int)(sizeof(shots)/sizeof(shots[0]));
+
+	uint64_t all = 0;
+	for(int s=0;s<numShots;s++)
+	{
+		table t;
+		fixedTable f(t);
+		f.ApplyImpulse(0, shots[s][0], shots[s][1]);
+		//chain every step's hash : nodes in step agree on all of them
+		uint64_t chain = f.StateHash();
+		while(f.AnyBallsMoving() && f.Steps()<100000)
+		{
+			f.Update(SIM_UPDATE_MS);
+			chain = Mix64(chain ^ f.StateHash());
+		}
+		printf("shot %d : %5u steps, final %016llx, chain %016llx, cue ball at (%.5f, %.5f)\n", s, f.Steps(),
+			(unsigned long long)f.StateHash(), (unsigned long long)chain, FixedToDouble(f.Ball(0).px), FixedToDouble(f.Ball(0).pz));
+		all = Mix64(all ^ chain);
+	}
+	printf("check %016llx\n", (unsigned long long)all);
+	return 0;
+}
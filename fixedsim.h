@@ -0,0 +1,98 @@
+/*-----------------------------------------------------------
+  Fixed Point Simulation Header File
+  An integer build of the ball/table solver for lockstep
+  multiplayer. Every quantity is a 16.16 fixed point number
+  and every operation is integer arithmetic with defined
+  rounding, so the same inputs give bit-identical states on
+  any compiler, flags and CPU. Nodes then only need to swap
+  their inputs (fixed point impulses) and compare the state
+  hash after each step, instead of sending the whole table.
+  The physics follows the double solver (friction, cushion
+  restitution, elastic ball hits) but the results are not
+  equal to it : this build is exact against itself only.
+  -----------------------------------------------------------*/
+#ifndef fixedsim_h_included
+#define fixedsim_h_included
+
+#include"simulation.h"
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define FIXED_SHIFT		(16)
+#define FIXED_ONE		(1<<FIXED_SHIFT)
+
+typedef int32_t fixed;
+
+//conversions for setting up and reading out; the double to fixed
+//one is only deterministic for values that came from integers or
+//from the same binary, so exchange fixed values between nodes
+inline fixed FixedFromDouble(double x) {return (fixed)floor((x*FIXED_ONE) + 0.5);}
+inline double FixedToDouble(fixed x) {return ((double)x)/FIXED_ONE;}
+
+//deterministic integer square root, floor(sqrt(x))
+uint32_t ISqrt64(uint64_t x);
+
+/*-----------------------------------------------------------
+  fixedBall : a ball's state in fixed point
+  -----------------------------------------------------------*/
+struct fixedBall
+{
+	fixed	px, pz;		//m
+	fixed	vx, vz;		//m/s
+	fixed	radius;		//m
+	fixed	mass;		//kg
+};
+
+/*-----------------------------------------------------------
+  fixedTable class
+  The rectangular table of a table (any number of balls) in
+  fixed point. Balls that would move more than CCD_MAX_TRAVEL
+  in a step make the whole step run in equal integer
+  sub-steps, which keeps the rule simple to reproduce.
+  -----------------------------------------------------------*/
+class fixedTable
+{
+private:
+	fixed minX, maxX, minZ, maxZ;
+	fixed restitution;		//fraction of the normal speed kept
+	fixed frictionDecel;	//m/s^2
+	fixed smallVelocity;	//m/s, slower balls stop
+	fixed maxTravel;		//m per (sub-)step
+	std::vector<fixedBall> balls;
+	std::vector<int> activeList;
+	std::vector<char> isActive;
+	int activeCount;
+	unsigned int steps;
+	uint64_t hash;
+	std::vector<uint64_t> ballHash;
+
+	void Wake(int i);
+	void Rehash(int i);
+	void SubStep(int ms);
+	void Friction(fixedBall &b, int ms);
+	void HitBall(fixedBall &a, fixedBall &b);
+
+public:
+	//copies t's balls, bounds and the physics coefficients
+	fixedTable(const table &t);
+
+	int NumBalls(void) const {return (int)balls.size();}
+	const fixedBall &Ball(int i) const {return balls[i];}
+	bool AnyBallsMoving(void) const {return activeCount>0;}
+	unsigned int Steps(void) const {return steps;}
+	//hash of the exact state, kept up to date incrementally : equal
+	//hashes after a step mean the nodes are still in step
+	uint64_t StateHash(void) const {return hash;}
+
+	void ApplyImpulse(int i, fixed vx, fixed vz);
+	void Update(int ms);
+	//write the state back to a double table with the same balls
+	void Store(table &t) const;
+};
+
+//console mode : simulate a fixed set of shots and print the hashes,
+//to compare builds and machines
+int RunFixedCheck(void);
+
+#endif
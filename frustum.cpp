@@ -0,0 +1,66 @@
+/*-----------------------------------------------------------
+  Frustum Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"frustum.h"
+
+/*-----------------------------------------------------------
+  frustum class members
+  -----------------------------------------------------------*/
+frustum::frustum():tanX(1.0f),tanY(1.0f),zNear(0.1f),zFar(1000.0f),
+	eye(0.0f,0.0f,0.0f),forward(0.0f,0.0f,-1.0f),right(1.0f,0.0f,0.0f),up(0.0f,1.0f,0.0f)
+{
+	Build();
+}
+
+void frustum::SetPerspective(float fovyDegrees, float aspect, float n, float f)
+{
+	tanY = (float)tan((fovyDegrees*3.14159265358979/180.0)/2.0);
+	tanX = tanY*aspect;
+	zNear = n;
+	zFar = f;
+	Build();
+}
+
+void frustum::SetLookAt(const vec4 &from, const vec4 &at, const vec4 &upHint)
+{
+	//the same basis gluLookAt builds
+	eye = from;
+	forward = (at - from).Normalised3();
+	right = forward.Cross3(upHint).Normalised3();
+	up = right.Cross3(forward);
+	Build();
+}
+
+static vec4 Plane(const vec4 &normal, const vec4 &point)
+{
+	vec4 n = normal.Normalised3();
+	vec4 p = n;
+	p(3) = -n.Dot3(point);
+	return p;
+}
+
+void frustum::Build(void)
+{
+	//in camera space a point (x,y,z) with z forward is inside the
+	//sides when |x| <= z*tanX and |y| <= z*tanY; each side's inward
+	//normal is then the side axis plus forward*tan
+	planes[0] = Plane(right + forward*tanX, eye);
+	planes[1] = Plane(forward*tanX - right, eye);
+	planes[2] = Plane(up + forward*tanY, eye);
+	planes[3] = Plane(forward*tanY - up, eye);
+	planes[4] = Plane(forward, forward.MulAdd(zNear, eye));
+	planes[5] = Plane(-forward, forward.MulAdd(zFar, eye));
+}
+
+int frustum::ClassifySphere(const vec4 &centre, float radius) const
+{
+	int result = FRUSTUM_INSIDE;
+	for(int i=0;i<6;i++)
+	{
+		float d = planes[i].Dot3(centre) + planes[i](3);
+		if(d < -radius) return FRUSTUM_OUTSIDE;
+		if(d < radius) result = FRUSTUM_INTERSECT;
+	}
+	return result;
+}
@@ -0,0 +1,55 @@
+/*-----------------------------------------------------------
+  Frustum Header File
+  The camera's view volume as six planes in world space, so
+  objects outside it can be skipped before any GL calls.
+  -----------------------------------------------------------*/
+#ifndef frustum_h_included
+#define frustum_h_included
+
+#include"vecmath.h"
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define FRUSTUM_OUTSIDE		(0)
+#define FRUSTUM_INTERSECT	(1)
+#define FRUSTUM_INSIDE		(2)
+
+/*-----------------------------------------------------------
+  frustum class
+  Set the projection with the gluPerspective arguments and the
+  view with the gluLookAt ones; the planes are rebuilt from
+  both. Each plane is (normal, d) with the normal pointing in,
+  so a point p is inside when normal.p + d >= 0.
+  -----------------------------------------------------------*/
+class frustum
+{
+private:
+	vec4	planes[6];	//left, right, bottom, top, near, far
+	float	tanX;		//half angle tangents of the projection
+	float	tanY;
+	float	zNear;
+	float	zFar;
+	vec4	eye;
+	vec4	forward;
+	vec4	right;
+	vec4	up;
+
+	void Build(void);
+
+public:
+	VECMATH_ALIGNED_NEW
+
+	frustum();
+	void SetPerspective(float fovyDegrees, float aspect, float n, float f);
+	void SetLookAt(const vec4 &from, const vec4 &at, const vec4 &upHint);
+
+	//FRUSTUM_OUTSIDE, FRUSTUM_INTERSECT or FRUSTUM_INSIDE
+	int ClassifySphere(const vec4 &centre, float radius) const;
+	bool SphereVisible(const vec4 &centre, float radius) const
+	{
+		return ClassifySphere(centre, radius)!=FRUSTUM_OUTSIDE;
+	}
+};
+
+#endif
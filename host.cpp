@@ -0,0 +1,432 @@
+/*-----------------------------------------------------------
+  Host Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"host.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#define CloseSocket(s)	closesocket((SOCKET)(s))
+#define BAD_SOCKET		((intptr_t)INVALID_SOCKET)
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#define CloseSocket(s)	close((int)(s))
+#define BAD_SOCKET		((intptr_t)-1)
+#endif
+
+/*-----------------------------------------------------------
+  platform helpers
+  -----------------------------------------------------------*/
+static void InitSockets(void)
+{
+#ifdef _WIN32
+	static bool done = false;
+	if(done) return;
+	WSADATA data;
+	WSAStartup(MAKEWORD(2,2), &data);
+	done = true;
+#else
+	//a client hanging up mid write must not kill the process
+	signal(SIGPIPE, SIG_IGN);
+#endif
+}
+
+static intptr_t ConnectSocket(const char *path)
+{
+	InitSockets();
+	intptr_t s = (intptr_t)socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s==BAD_SOCKET) return BAD_SOCKET;
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+	if(connect(s, (sockaddr *)&addr, sizeof(addr))!=0)
+	{
+		CloseSocket(s);
+		return BAD_SOCKET;
+	}
+	return s;
+}
+
+//a socket left by an earlier host that did not shut down. Only
+//ever a socket : the path is the user's, and may name a real file
+static void RemoveStaleSocket(const char *path)
+{
+#ifdef _WIN32
+	DWORD a = GetFileAttributesA(path);
+	if(a!=INVALID_FILE_ATTRIBUTES && (a & FILE_ATTRIBUTE_REPARSE_POINT)) DeleteFileA(path);
+#else
+	struct stat st;
+	if(lstat(path, &st)==0 && S_ISSOCK(st.st_mode)) unlink(path);
+#endif
+}
+
+//accept failed : keep listening through a signal or a full descriptor
+//table, but not through a socket that is broken
+static bool AcceptRetryable(void)
+{
+#ifdef _WIN32
+	int e = WSAGetLastError();
+	return e==WSAEINTR || e==WSAEMFILE || e==WSAENOBUFS || e==WSAECONNRESET;
+#else
+	return errno==EINTR || errno==EMFILE || errno==ENFILE || errno==ENOBUFS ||
+		errno==ENOMEM || errno==ECONNABORTED || errno==EPROTO;
+#endif
+}
+
+/*-----------------------------------------------------------
+  tableHost class members
+  -----------------------------------------------------------*/
+tableHost::tableHost(int n, int numThreads):
+	numTables(n), pool(numThreads, true),
+	listening(false), listenSocket(BAD_SOCKET),
+	ticks(0), overruns(0), commandsReceived(0), shotsApplied(0), shotsDropped(0)
+{
+	tables = new table[numTables];
+
+	//sized from what a table really holds, its balls and buffers on
+	//the heap included, and small enough that every worker gets a few
+	size_t footprint = numTables ? tables[0].Footprint() : sizeof(table);
+	batchSize = (int)(HOST_BATCH_BYTES/footprint);
+	int threads = (pool.NumThreads()>0) ? pool.NumThreads() : 1;
+	int spread = numTables/(threads*HOST_BATCHES_PER_THREAD);
+	if(batchSize>spread) batchSize = spread;
+	if(batchSize<1) batchSize = 1;
+	socketPath[0] = 0;
+}
+
+tableHost::~tableHost()
+{
+	StopListening();
+	delete [] tables;
+}
+
+void tableHost::TickBatch(void *context, int first, int last)
+{
+	table *tables = ((tableHost *)context)->tables;
+	for(int i=first;i<last;i++)
+	{
+		if(tables[i].AnyBallsMoving()) tables[i].Update(HOST_TICK_MS);
+	}
+}
+
+void tableHost::Push(const hostCommand &c)
+{
+	std::lock_guard<std::mutex> guard(commandLock);
+	commands.push_back(c);
+}
+
+void tableHost::ApplyCommands(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(commandLock);
+		applying.swap(commands);
+	}
+	for(size_t i=0;i<applying.size();i++)
+	{
+		const hostCommand &c = applying[i];
+		//same rule as the game : no shot until everything has stopped
+		if(c.table<0 || c.table>=numTables || tables[c.table].AnyBallsMoving())
+		{
+			shotsDropped++;
+			continue;
+		}
+		vec2 imp((-sin(c.angle) * c.power * CUE_BALL_FACTOR), (-cos(c.angle) * c.power * CUE_BALL_FACTOR));
+		tables[c.table].ApplyImpulse(0, imp);
+		shotsApplied++;
+	}
+	applying.clear();
+}
+
+void tableHost::Tick(void)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	ApplyCommands();
+	pool.ParallelFor(numTables, batchSize, TickBatch, this);
+
+	std::chrono::duration<float, std::micro> d = std::chrono::steady_clock::now() - start;
+	tickMicros[ticks & (HOST_TICK_HISTORY-1)] = d.count();
+	ticks++;
+}
+
+void tableHost::Run(const std::atomic<bool> &stop, long maxTicks)
+{
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	while(!stop && (maxTicks<0 || ticks<maxTicks))
+	{
+		Tick();
+		next += std::chrono::milliseconds(HOST_TICK_MS);
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if(now>next)
+		{
+			//fell behind : don't try to catch up with a burst of ticks
+			overruns++;
+			next = now;
+		}
+		else std::this_thread::sleep_until(next);
+	}
+}
+
+float tableHost::TickPercentile(float p) const
+{
+	if(ticks==0) return 0.0f;
+	size_t n = (ticks<HOST_TICK_HISTORY) ? (size_t)ticks : HOST_TICK_HISTORY;
+	std::vector<float> sorted(tickMicros, tickMicros+n);
+	size_t k = (size_t)((p/100.0f)*(sorted.size()-1) + 0.5f);
+	std::nth_element(sorted.begin(), sorted.begin()+k, sorted.end());
+	return sorted[k];
+}
+
+bool tableHost::Listen(const char *path)
+{
+	InitSockets();
+	strncpy(socketPath, path, sizeof(socketPath)-1);
+	socketPath[sizeof(socketPath)-1] = 0;
+
+	intptr_t s = (intptr_t)socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s==BAD_SOCKET) return false;
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+	RemoveStaleSocket(path);
+	if(bind(s, (sockaddr *)&addr, sizeof(addr))!=0 || listen(s, 64)!=0)
+	{
+		CloseSocket(s);
+		return false;
+	}
+	listenSocket = s;
+	listening = true;
+	acceptThread = std::thread(&tableHost::AcceptLoop, this);
+	return true;
+}
+
+void tableHost::StopListening(void)
+{
+	if(!listening) return;
+	listening = false;
+	//closing the sockets unblocks accept and recv
+#ifndef _WIN32
+	shutdown((int)listenSocket, SHUT_RDWR);
+#endif
+	CloseSocket(listenSocket);
+	acceptThread.join();
+	{
+		std::lock_guard<std::mutex> guard(connectionLock);
+		for(size_t i=0;i<connections.size();i++)
+		{
+#ifdef _WIN32
+			shutdown((SOCKET)connections[i], SD_BOTH);
+#else
+			shutdown((int)connections[i], SHUT_RDWR);
+#endif
+		}
+	}
+	for(size_t i=0;i<connectionThreads.size();i++) connectionThreads[i].join();
+	connectionThreads.clear();
+	finished.clear();
+	for(size_t i=0;i<connections.size();i++) CloseSocket(connections[i]);
+	connections.clear();
+	RemoveStaleSocket(socketPath);
+}
+
+void tableHost::AcceptLoop(void)
+{
+	while(listening)
+	{
+		intptr_t c = (intptr_t)accept(listenSocket, 0, 0);
+		if(c==BAD_SOCKET)
+		{
+			if(!listening) break;
+			if(!AcceptRetryable())
+			{
+				printf("host : accept failed, no longer taking connections\n");
+				break;
+			}
+			//only a signal is worth an immediate retry, out of descriptors
+			//or memory would otherwise spin
+#ifdef _WIN32
+			if(WSAGetLastError()!=WSAEINTR)
+#else
+			if(errno!=EINTR)
+#endif
+				std::this_thread::sleep_for(std::chrono::milliseconds(HOST_ACCEPT_RETRY_MS));
+			continue;
+		}
+		std::lock_guard<std::mutex> guard(connectionLock);
+		if(!listening)
+		{
+			CloseSocket(c);
+			break;
+		}
+		ReapConnections();
+		connections.push_back(c);
+		connectionThreads.push_back(std::thread(&tableHost::ConnectionLoop, this, c));
+	}
+}
+
+void tableHost::ConnectionLoop(intptr_t s)
+{
+	char buffer[HOST_MAX_LINE*16];
+	int used = 0;
+	for(;;)
+	{
+		int n = (int)recv(s, buffer+used, sizeof(buffer)-1-used, 0);
+		if(n<=0)
+		{
+			EndConnection(s);
+			return;
+		}
+		used += n;
+		buffer[used] = 0;
+
+		//handle every complete line, keep the tail for the next read
+		char *line = buffer;
+		char *end;
+		while((end = strchr(line, '\n'))!=0)
+		{
+			*end = 0;
+			hostCommand c;
+			if(sscanf(line, "shot %d %f %f", &c.table, &c.angle, &c.power)==3)
+			{
+				commandsReceived++;
+				Push(c);
+			}
+			line = end+1;
+		}
+		used = (int)(buffer+used-line);
+		memmove(buffer, line, used);
+		//a line that will never fit is junk
+		if(used>=(int)sizeof(buffer)-1) used = 0;
+	}
+}
+
+//the peer has gone (or StopListening shut the socket) : close it here,
+//under the lock so StopListening never shuts a reused descriptor, and
+//leave the thread for AcceptLoop to join
+void tableHost::EndConnection(intptr_t s)
+{
+	std::lock_guard<std::mutex> guard(connectionLock);
+	std::vector<intptr_t>::iterator it = std::find(connections.begin(), connections.end(), s);
+	if(it!=connections.end()) connections.erase(it);
+	CloseSocket(s);
+	finished.push_back(std::this_thread::get_id());
+}
+
+//join the connection threads that have ended, connectionLock held
+void tableHost::ReapConnections(void)
+{
+	for(size_t i=0;i<finished.size();i++)
+	{
+		for(size_t k=0;k<connectionThreads.size();k++)
+		{
+			if(connectionThreads[k].get_id()!=finished[i]) continue;
+			connectionThreads[k].join();
+			connectionThreads.erase(connectionThreads.begin()+k);
+			break;
+		}
+	}
+	finished.clear();
+}
+
+/*-----------------------------------------------------------
+  console modes
+  -----------------------------------------------------------*/
+int RunHost(int numTables, int numThreads, const char *path)
+{
+	tableHost host(numTables, numThreads);
+	if(!host.Listen(path))
+	{
+		printf("could not listen on %s\n", path);
+		return 1;
+	}
+	printf("hosting %d tables on %s, %d tables per batch\n", numTables, path, host.BatchSize());
+	std::atomic<bool> stop(false);
+	host.Run(stop);
+	return 0;
+}
+
+int RunLoadGenerator(int numTables, int numClients, int seconds, int numThreads)
+{
+	//each client owns a table and takes a shot every few seconds,
+	//the clients share a handful of connections
+	static const int maxConnections = 16;
+	static const float meanShotInterval = 4.0f;
+
+	tableHost host(numTables, numThreads);
+	if(!host.Listen(HOST_SOCKET_PATH))
+	{
+		printf("could not listen on %s\n", HOST_SOCKET_PATH);
+		return 1;
+	}
+	std::atomic<bool> stop(false);
+	std::thread hostThread(&tableHost::Run, &host, std::cref(stop), -1L);
+
+	int numConnections = std::min(numClients, maxConnections);
+	std::atomic<long> sent(0);
+	std::vector<std::thread> clients;
+	for(int c=0;c<numConnections;c++)
+	{
+		clients.push_back(std::thread([&, c]()
+		{
+			intptr_t s = ConnectSocket(HOST_SOCKET_PATH);
+			if(s==BAD_SOCKET) return;
+			std::mt19937 rng(1234+c);
+			std::exponential_distribution<float> interval(1.0f/meanShotInterval);
+			std::uniform_real_distribution<float> angle(0.0f, TWO_PI);
+			std::uniform_real_distribution<float> power(0.1f, 0.75f);
+
+			typedef std::chrono::steady_clock clock;
+			std::vector<clock::time_point> due;
+			std::vector<int> tableOf;
+			for(int k=c;k<numClients;k+=numConnections)
+			{
+				due.push_back(clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(interval(rng))));
+				tableOf.push_back(k % numTables);
+			}
+			char line[HOST_MAX_LINE];
+			while(!stop)
+			{
+				clock::time_point now = clock::now();
+				for(size_t k=0;k<due.size();k++)
+				{
+					if(due[k]>now) continue;
+					int len = sprintf(line, "shot %d %f %f\n", tableOf[k], angle(rng), power(rng));
+					if(send(s, line, len, 0)!=len) { stop = true; break; }
+					sent++;
+					due[k] = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(interval(rng)));
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			CloseSocket(s);
+		}));
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	stop = true;
+	for(size_t i=0;i<clients.size();i++) clients[i].join();
+	hostThread.join();
+	host.StopListening();
+
+	int moving = 0;
+	for(int i=0;i<host.NumTables();i++) if(host.Table(i).AnyBallsMoving()) moving++;
+	printf("tables %d, clients %d, connections %d, %d s\n", numTables, numClients, numConnections, seconds);
+	printf("ticks %ld, overruns %ld, moving at end %d\n", host.ticks, host.overruns, moving);
+	printf("shots sent %ld, received %ld, applied %ld, dropped %ld\n", (long)sent, (long)host.commandsReceived, host.shotsApplied, host.shotsDropped);
+	printf("tick us : p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+		host.TickPercentile(50.0f), host.TickPercentile(90.0f), host.TickPercentile(99.0f),
+		host.TickPercentile(99.9f), host.TickPercentile(100.0f));
+	return 0;
+}
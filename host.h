@@ -0,0 +1,112 @@
+/*-----------------------------------------------------------
+  Host Header File
+  Runs many independent tables in one process : fixed ticks,
+  tables advanced in cache sized batches on a pool of pinned
+  worker threads, cue commands taken from a local socket.
+  -----------------------------------------------------------*/
+#ifndef host_h_included
+#define host_h_included
+
+#include"simulation.h"
+#include"workerpool.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define HOST_TICK_MS		(SIM_UPDATE_MS)
+#define HOST_BATCH_BYTES	(256*1024)		//aim a batch at an L2 sized slice
+#define HOST_BATCHES_PER_THREAD	(4)		//at least, so the workers balance
+#define HOST_SOCKET_PATH	"pool_host.sock"
+#define HOST_MAX_LINE		(128)
+#define HOST_TICK_HISTORY	(8192)			//ticks kept for the percentiles, a power of 2
+#define HOST_ACCEPT_RETRY_MS	(100)		//wait after accept fails, e.g. out of descriptors
+
+/*-----------------------------------------------------------
+  hostCommand : a cue shot on one table
+  wire format, one per line :  shot <table> <angle> <power>
+  -----------------------------------------------------------*/
+struct hostCommand
+{
+	int		table;
+	float	angle;
+	float	power;
+};
+
+/*-----------------------------------------------------------
+  tableHost class
+  -----------------------------------------------------------*/
+class tableHost
+{
+private:
+	table	*tables;
+	int		numTables;
+	int		batchSize;
+
+	//pinned workers, each takes whole batches of tables per tick
+	workerPool	pool;
+
+	//commands from the socket, applied at the start of a tick
+	std::mutex					commandLock;
+	std::vector<hostCommand>	commands;
+	std::vector<hostCommand>	applying;
+
+	//socket
+	std::atomic<bool>			listening;
+	intptr_t					listenSocket;
+	std::thread					acceptThread;
+	std::mutex					connectionLock;
+	std::vector<intptr_t>		connections;
+	std::vector<std::thread>	connectionThreads;
+	std::vector<std::thread::id>	finished;	//connections the peer closed, to join
+	char						socketPath[256];
+
+	static void TickBatch(void *context, int first, int last);
+	void AcceptLoop(void);
+	void ConnectionLoop(intptr_t s);
+	void EndConnection(intptr_t s);
+	void ReapConnections(void);
+	void ApplyCommands(void);
+
+	tableHost(const tableHost &);
+	tableHost &operator =(const tableHost &);
+
+public:
+	//stats
+	float				tickMicros[HOST_TICK_HISTORY];	//compute time of the last ticks, a ring
+	long				ticks;
+	long				overruns;		//ticks that missed their deadline
+	std::atomic<long>	commandsReceived;
+	long				shotsApplied;
+	long				shotsDropped;	//table was still moving, or no such table
+
+	//numThreads 0 means one per hardware thread
+	tableHost(int numTables, int numThreads);
+	~tableHost();
+
+	int NumTables(void) const {return numTables;}
+	int BatchSize(void) const {return batchSize;}
+	table &Table(int i) {return tables[i];}
+
+	//thread safe, the shot is played at the next tick
+	void Push(const hostCommand &c);
+	bool Listen(const char *path);
+	void StopListening(void);
+
+	//advance every moving table by one tick
+	void Tick(void);
+	//tick at HOST_TICK_MS intervals until stop is set (or for maxTicks if >= 0)
+	void Run(const std::atomic<bool> &stop, long maxTicks = -1);
+	//tick latency in microseconds at percentile p (0-100), over the
+	//last HOST_TICK_HISTORY ticks
+	float TickPercentile(float p) const;
+};
+
+//console modes
+int RunHost(int numTables, int numThreads, const char *path);
+int RunLoadGenerator(int numTables, int numClients, int seconds, int numThreads);
+
+#endif
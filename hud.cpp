@@ -0,0 +1,276 @@
+/*-----------------------------------------------------------
+  HUD Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"hud.h"
+#include"alloctrack.h"
+#include <math.h>
+#include <string.h>
+#include <ctype.h>
+#include <chrono>
+#include<glut.h>
+
+/*-----------------------------------------------------------
+  font
+  5x7 glyphs, top row first, bit 4 the left column, packed
+  into a texture of 16x8 cells of 8x8 texels and drawn
+  doubled. Upper case uses the lower case glyphs, anything
+  missing is blank
+  -----------------------------------------------------------*/
+#define GLYPH_W		(5)
+#define GLYPH_H		(7)
+#define GLYPH_SCALE	(2)
+#define LINE_HEIGHT	(GLYPH_H*GLYPH_SCALE + 4)
+#define FONT_CELL	(8)
+#define FONT_COLS	(16)
+#define FONT_ROWS	(8)
+
+struct glyph
+{
+	char			c;
+	unsigned char	rows[GLYPH_H];
+};
+
+static const glyph glyphs[] = {
+	{'0', {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}},
+	{'1', {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}},
+	{'2', {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}},
+	{'3', {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}},
+	{'4', {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}},
+	{'5', {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}},
+	{'6', {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}},
+	{'7', {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+	{'8', {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}},
+	{'9', {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}},
+	{'a', {0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f}},
+	{'b', {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e}},
+	{'c', {0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e}},
+	{'d', {0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f}},
+	{'e', {0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e}},
+	{'f', {0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08}},
+	{'g', {0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e}},
+	{'h', {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11}},
+	{'i', {0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e}},
+	{'j', {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c}},
+	{'k', {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12}},
+	{'l', {0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}},
+	{'m', {0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11}},
+	{'n', {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}},
+	{'o', {0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e}},
+	{'p', {0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10}},
+	{'q', {0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01}},
+	{'r', {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}},
+	{'s', {0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e}},
+	{'t', {0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06}},
+	{'u', {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d}},
+	{'v', {0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04}},
+	{'w', {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a}},
+	{'x', {0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11}},
+	{'y', {0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e}},
+	{'z', {0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f}},
+	{'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}},
+	{':', {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}},
+	{'/', {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}},
+	{'%', {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}},
+	{'-', {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}},
+	{'(', {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}},
+	{')', {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}},
+	{'=', {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}},
+};
+
+/*-----------------------------------------------------------
+  rollingStat class members
+  -----------------------------------------------------------*/
+rollingStat::rollingStat(float lowest):next(0),count(0),sum(0.0),low(lowest)
+{
+	memset(samples, 0, sizeof(samples));
+	memset(buckets, 0, sizeof(buckets));
+}
+
+int rollingStat::Bucket(float v) const
+{
+	if(v<=low) return 0;
+	int b = (int)(4.0f*log2f(v/low)) + 1;
+	return (b<HUD_BUCKETS) ? b : HUD_BUCKETS-1;
+}
+
+void rollingStat::Add(float v)
+{
+	if(count==HUD_WINDOW)
+	{
+		//the oldest sample leaves the window
+		float old = samples[next];
+		sum -= old;
+		buckets[Bucket(old)]--;
+	}
+	else count++;
+	samples[next] = v;
+	next = (next + 1) % HUD_WINDOW;
+	sum += v;
+	buckets[Bucket(v)]++;
+}
+
+float rollingStat::Percentile(float p) const
+{
+	if(count==0) return 0.0f;
+	int target = (int)ceilf(p*count);
+	int seen = 0;
+	for(int b=0;b<HUD_BUCKETS;b++)
+	{
+		seen += buckets[b];
+		if(seen>=target) return low*powf(2.0f, b/4.0f);
+	}
+	return low*powf(2.0f, (HUD_BUCKETS-1)/4.0f);
+}
+
+/*-----------------------------------------------------------
+  perfHud class members
+  -----------------------------------------------------------*/
+perfHud::perfHud():visible(false),fontTexture(0),steps(0),tableMs(0.0f),particleMs(0.0f),hits(0),
+	frameMs(0.1f),stepsPerFrame(0.25f),tableFrameMs(0.001f),particleFrameMs(0.001f),renderMs(0.01f),
+	hudMs(0.001f),hitsPerFrame(0.25f),allocsPerFrame(0.25f),liveSets(0),liveParticles(0),lastAllocs(0)
+{
+	memset(text, 0, sizeof(text));
+}
+
+void perfHud::Step(float tableUpdateMs, float particleUpdateMs, int collisions)
+{
+	steps++;
+	tableMs += tableUpdateMs;
+	particleMs += particleUpdateMs;
+	hits += collisions;
+}
+
+void perfHud::Frame(float frameTimeMs, float renderTimeMs, int sets, int particles)
+{
+	uint64_t allocs = AllocationCount();
+	if(lastAllocs) allocsPerFrame.Add((float)(allocs - lastAllocs));
+	lastAllocs = allocs;
+
+	frameMs.Add(frameTimeMs);
+	renderMs.Add(renderTimeMs);
+	stepsPerFrame.Add((float)steps);
+	tableFrameMs.Add(tableMs);
+	particleFrameMs.Add(particleMs);
+	hitsPerFrame.Add((float)hits);
+	liveSets = sets;
+	liveParticles = particles;
+	steps = 0;
+	tableMs = particleMs = 0.0f;
+	hits = 0;
+}
+
+void perfHud::BuildFont(void)
+{
+	//alpha only : the text takes the current colour
+	static unsigned char texels[FONT_ROWS*FONT_CELL][FONT_COLS*FONT_CELL];
+	memset(texels, 0, sizeof(texels));
+	for(int c=0;c<128;c++)
+	{
+		int cellX = (c % FONT_COLS)*FONT_CELL, cellY = (c / FONT_COLS)*FONT_CELL;
+		for(size_t g=0;g<sizeof(glyphs)/sizeof(glyphs[0]);g++)
+		{
+			if(glyphs[g].c!=tolower(c)) continue;
+			for(int row=0;row<GLYPH_H;row++)
+				for(int x=0;x<GLYPH_W;x++)
+					if(glyphs[g].rows[row] & (0x10 >> x)) texels[cellY + GLYPH_H - 1 - row][cellX + x] = 0xff;
+			break;
+		}
+	}
+	glGenTextures(1, &fontTexture);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, FONT_COLS*FONT_CELL, FONT_ROWS*FONT_CELL, 0, GL_ALPHA, GL_UNSIGNED_BYTE, texels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void perfHud::Draw(int width, int height)
+{
+	if(!visible) return;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	if(!fontTexture) BuildFont();
+
+	float frame = frameMs.Mean();
+	snprintf(text[0], HUD_LINE_CHARS, "frame  %6.2f ms  p95 %6.2f  %5.1f fps", frame, frameMs.Percentile(0.95f), frame>0.0f ? 1000.0f/frame : 0.0f);
+	snprintf(text[1], HUD_LINE_CHARS, "steps  %4.2f per frame", stepsPerFrame.Mean());
+	snprintf(text[2], HUD_LINE_CHARS, "table  %6.3f ms  p95 %6.3f", tableFrameMs.Mean(), tableFrameMs.Percentile(0.95f));
+	snprintf(text[3], HUD_LINE_CHARS, "parts  %6.3f ms  p95 %6.3f", particleFrameMs.Mean(), particleFrameMs.Percentile(0.95f));
+	snprintf(text[4], HUD_LINE_CHARS, "render %6.3f ms  p95 %6.3f", renderMs.Mean(), renderMs.Percentile(0.95f));
+	snprintf(text[5], HUD_LINE_CHARS, "hud    %6.3f ms", hudMs.Mean());
+	snprintf(text[6], HUD_LINE_CHARS, "sets   %d  particles %d", liveSets, liveParticles);
+	snprintf(text[7], HUD_LINE_CHARS, "hits   %6.1f per s", frame>0.0f ? hitsPerFrame.Mean()*1000.0f/frame : 0.0f);
+	snprintf(text[8], HUD_LINE_CHARS, "allocs %6.1f per frame  p95 %.0f", allocsPerFrame.Mean(), allocsPerFrame.Percentile(0.95f));
+
+	//frame time graph along the bottom, 2 pixels a millisecond
+	int n = frameMs.Count();
+	for(int i=0;i<n;i++)
+	{
+		float h = frameMs.Sample(i)*2.0f;
+		if(h>100.0f) h = 100.0f;
+		bars[i*4] = bars[i*4+2] = 8.0f + i*2.0f;
+		bars[i*4+1] = 8.0f;
+		bars[i*4+3] = 8.0f + h;
+	}
+
+	//a quad per character, bottom left corner first
+	int numQuads = 0;
+	for(int i=0;i<HUD_LINES;i++)
+	{
+		float y = (float)(height - (i+1)*LINE_HEIGHT);
+		for(int k=0;text[i][k];k++)
+		{
+			unsigned char c = (unsigned char)text[i][k];
+			if(c==' ' || c>=128) continue;
+			float x = (float)(8 + k*(GLYPH_W+1)*GLYPH_SCALE);
+			float u = (float)((c % FONT_COLS)*FONT_CELL)/(FONT_COLS*FONT_CELL);
+			float v = (float)((c / FONT_COLS)*FONT_CELL)/(FONT_ROWS*FONT_CELL);
+			float du = (float)GLYPH_W/(FONT_COLS*FONT_CELL), dv = (float)GLYPH_H/(FONT_ROWS*FONT_CELL);
+			float w = (float)(GLYPH_W*GLYPH_SCALE), h = (float)(GLYPH_H*GLYPH_SCALE);
+			float corners[16] = {x, y, u, v,  x+w, y, u+du, v,  x+w, y+h, u+du, v+dv,  x, y+h, u, v+dv};
+			memcpy(&quads[numQuads*16], corners, sizeof(corners));
+			numQuads++;
+		}
+	}
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_LIGHTING);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, width, 0.0, height, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glColor3f(0.0f,1.0f,0.0f);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 0, bars);
+	glDrawArrays(GL_LINES, 0, n*2);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glColor3f(1.0f,1.0f,0.5f);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glEnable(GL_ALPHA_TEST);
+	glAlphaFunc(GL_GREATER, 0.5f);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 4*sizeof(float), quads);
+	glTexCoordPointer(2, GL_FLOAT, 4*sizeof(float), quads + 2);
+	glDrawArrays(GL_QUADS, 0, numQuads*4);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+
+	hudMs.Add(std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+}
@@ -0,0 +1,102 @@
+/*-----------------------------------------------------------
+  HUD Header File
+  A performance overlay for tuning without a profiler : frame
+  time, simulation steps per frame, time in the table and
+  particle updates and in rendering, particle counts, hits
+  per second and heap allocations per frame. Every value is
+  kept in a rolling window with a histogram, so the overlay
+  shows steady means and 95th percentiles rather than numbers
+  that flicker every frame. Text comes from a texture of a
+  built-in 5x7 font, every character a quad in one draw, so
+  it needs no glut font and costs little on any driver.
+  -----------------------------------------------------------*/
+#ifndef hud_h_included
+#define hud_h_included
+
+#include <stdint.h>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define HUD_WINDOW		(120)	//frames in the rolling window
+#define HUD_BUCKETS		(64)	//histogram buckets, a quarter octave each
+#define HUD_LINES		(9)
+#define HUD_LINE_CHARS	(48)
+
+/*-----------------------------------------------------------
+  rollingStat class
+  The last HUD_WINDOW samples, their sum, and a histogram of
+  them in quarter octave buckets from low upwards, all kept
+  up to date as samples come and go. The percentile is the
+  top of the bucket it falls in, so within 19%.
+  -----------------------------------------------------------*/
+class rollingStat
+{
+private:
+	float	samples[HUD_WINDOW];
+	int		next;
+	int		count;
+	double	sum;
+	int		buckets[HUD_BUCKETS];
+	float	low;
+
+	int Bucket(float v) const;
+
+public:
+	rollingStat(float lowest);
+	void Add(float v);
+	float Mean(void) const {return count ? (float)(sum/count) : 0.0f;}
+	float Percentile(float p) const;
+	//i = 0 is the oldest sample in the window
+	float Sample(int i) const {return samples[(next - count + i + HUD_WINDOW) % HUD_WINDOW];}
+	int Count(void) const {return count;}
+};
+
+/*-----------------------------------------------------------
+  perfHud class
+  Step once per simulation step and Frame once per drawn
+  frame; Draw goes after the scene, before the swap.
+  -----------------------------------------------------------*/
+class perfHud
+{
+private:
+	bool		visible;
+	unsigned int	fontTexture;
+
+	//since the last frame
+	int			steps;
+	float		tableMs;
+	float		particleMs;
+	int			hits;
+
+	rollingStat	frameMs;
+	rollingStat	stepsPerFrame;
+	rollingStat	tableFrameMs;
+	rollingStat	particleFrameMs;
+	rollingStat	renderMs;
+	rollingStat	hudMs;
+	rollingStat	hitsPerFrame;
+	rollingStat	allocsPerFrame;
+	int			liveSets;
+	int			liveParticles;
+	uint64_t	lastAllocs;
+
+	char		text[HUD_LINES][HUD_LINE_CHARS];
+	float		bars[HUD_WINDOW*4];		//frame time graph, x,y pairs
+	float		quads[HUD_LINES*HUD_LINE_CHARS*16];	//text, x,y,u,v per corner
+
+	void BuildFont(void);
+
+public:
+	perfHud();
+
+	void Toggle(void) {visible = !visible;}
+	bool Visible(void) const {return visible;}
+
+	void Step(float tableUpdateMs, float particleUpdateMs, int collisions);
+	void Frame(float frameTimeMs, float renderTimeMs, int sets, int particles);
+	//in window pixels; restores the matrices and state it changes
+	void Draw(int width, int height);
+};
+
+#endif
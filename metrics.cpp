@@ -0,0 +1,210 @@
+/*-----------------------------------------------------------
+  Metrics Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"metrics.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+metricsExporter gMetrics;
+
+/*-----------------------------------------------------------
+  names
+  -----------------------------------------------------------*/
+static const char *gCounterNames[NUM_METRIC_COUNTERS][2] = {
+	{"pool_steps_total", "Table steps that moved at least one ball."},
+	{"pool_pair_tests_total", "Ball pairs tested by the narrowphase."},
+	{"pool_ball_hits_total", "Ball to ball collisions."},
+	{"pool_cushion_hits_total", "Ball to cushion collisions."},
+	{"pool_fireworks_total", "Fireworks that emitted particles."},
+	{"pool_particles_spawned_total", "Particles emitted by fireworks."},
+	{"pool_particles_reclaimed_total", "Particles that reached the ground."},
+};
+
+//upper bounds of the step latency buckets, ns
+static const uint64_t gLatencyBounds[METRICS_LATENCY_BUCKETS-1] = {
+	250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000, 5000000, 10000000,
+};
+
+/*-----------------------------------------------------------
+  shards
+  only the owning thread writes a shard, so it adds with a
+  plain load and store; the atomics just let the writer
+  thread read them. Threads past METRICS_SHARDS share the
+  last one and pay for a locked add
+  -----------------------------------------------------------*/
+struct alignas(64) metricsShard
+{
+	std::atomic<uint64_t>	counters[NUM_METRIC_COUNTERS];
+	std::atomic<uint64_t>	latency[METRICS_LATENCY_BUCKETS];
+	std::atomic<uint64_t>	latencyNs;
+	bool					shared;
+	bool					inUse;
+};
+
+static metricsShard gShards[METRICS_SHARDS];
+static std::mutex gShardLock;
+
+static metricsShard *ClaimShard(void)
+{
+	std::lock_guard<std::mutex> hold(gShardLock);
+	for(int i=0;i<METRICS_SHARDS-1;i++)
+	{
+		if(gShards[i].inUse) continue;
+		gShards[i].inUse = true;
+		return &gShards[i];
+	}
+	gShards[METRICS_SHARDS-1].shared = true;
+	return &gShards[METRICS_SHARDS-1];
+}
+
+//a thread that exits hands its shard on with its counts in it,
+//so the totals never go down
+struct shardLease
+{
+	metricsShard *shard;
+	shardLease():shard(ClaimShard()) {}
+	~shardLease()
+	{
+		std::lock_guard<std::mutex> hold(gShardLock);
+		if(!shard->shared) shard->inUse = false;
+	}
+};
+
+static thread_local metricsShard *tShard = 0;
+
+static metricsShard *Shard(void)
+{
+	if(!tShard)
+	{
+		static thread_local shardLease lease;
+		tShard = lease.shard;
+	}
+	return tShard;
+}
+
+static void Add(metricsShard *s, std::atomic<uint64_t> &v, uint64_t n)
+{
+	if(s->shared) v.fetch_add(n, std::memory_order_relaxed);
+	else v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void MetricAdd(metricCounter c, uint64_t n)
+{
+	metricsShard *s = Shard();
+	Add(s, s->counters[c], n);
+}
+
+void MetricTableStep(uint64_t pairTests, uint64_t ballHits, uint64_t cushionHits)
+{
+	metricsShard *s = Shard();
+	Add(s, s->counters[METRIC_STEPS], 1);
+	Add(s, s->counters[METRIC_PAIR_TESTS], pairTests);
+	Add(s, s->counters[METRIC_BALL_HITS], ballHits);
+	Add(s, s->counters[METRIC_CUSHION_HITS], cushionHits);
+}
+
+void MetricStepLatency(uint64_t ns)
+{
+	int b = 0;
+	while(b<METRICS_LATENCY_BUCKETS-1 && ns>gLatencyBounds[b]) b++;
+	metricsShard *s = Shard();
+	Add(s, s->latency[b], 1);
+	Add(s, s->latencyNs, ns);
+}
+
+/*-----------------------------------------------------------
+  metricsExporter class members
+  -----------------------------------------------------------*/
+bool metricsExporter::Start(const char *file, int ms)
+{
+	Stop();
+	if(!file || strlen(file)>=METRICS_PATH_MAX) return false;
+	strcpy(path, file);
+	sprintf(tempPath, "%s.tmp", path);
+	intervalMs = (ms>0) ? ms : METRICS_INTERVAL_MS;
+	if(!Write()) return false;
+	stopping = false;
+	writer = std::thread(&metricsExporter::WriterLoop, this);
+	return true;
+}
+
+void metricsExporter::Stop(void)
+{
+	if(!writer.joinable()) return;
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+	Write();
+}
+
+void metricsExporter::WriterLoop(void)
+{
+	std::unique_lock<std::mutex> hold(lock);
+	while(!stopping)
+	{
+		wake.wait_for(hold, std::chrono::milliseconds(intervalMs));
+		if(stopping) break;
+		hold.unlock();
+		Write();
+		hold.lock();
+	}
+}
+
+bool metricsExporter::Write(void)
+{
+	//sum the shards; the histogram count is the sum of its buckets,
+	//so the two always agree within one file
+	uint64_t counters[NUM_METRIC_COUNTERS] = {0};
+	uint64_t latency[METRICS_LATENCY_BUCKETS] = {0};
+	uint64_t latencyNs = 0;
+	for(int i=0;i<METRICS_SHARDS;i++)
+	{
+		const metricsShard &s = gShards[i];
+		for(int c=0;c<NUM_METRIC_COUNTERS;c++) counters[c] += s.counters[c].load(std::memory_order_relaxed);
+		for(int b=0;b<METRICS_LATENCY_BUCKETS;b++) latency[b] += s.latency[b].load(std::memory_order_relaxed);
+		latencyNs += s.latencyNs.load(std::memory_order_relaxed);
+	}
+
+	std::lock_guard<std::mutex> hold(writing);
+	FILE *f = fopen(tempPath, "wb");
+	if(!f) return false;
+	for(int c=0;c<NUM_METRIC_COUNTERS;c++)
+	{
+		fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", gCounterNames[c][0], gCounterNames[c][1], gCounterNames[c][0]);
+		fprintf(f, "%s %llu\n", gCounterNames[c][0], (unsigned long long)counters[c]);
+	}
+	fprintf(f, "# HELP pool_step_seconds Time taken by table steps that moved at least one ball, one in %d sampled.\n", METRICS_LATENCY_SAMPLE);
+	fprintf(f, "# TYPE pool_step_seconds histogram\n");
+	uint64_t cumulative = 0;
+	for(int b=0;b<METRICS_LATENCY_BUCKETS;b++)
+	{
+		cumulative += latency[b];
+		if(b<METRICS_LATENCY_BUCKETS-1) fprintf(f, "pool_step_seconds_bucket{le=\"%g\"} %llu\n", gLatencyBounds[b]/1e9, (unsigned long long)cumulative);
+		else fprintf(f, "pool_step_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+	}
+	fprintf(f, "pool_step_seconds_sum %.9f\n", latencyNs/1e9);
+	fprintf(f, "pool_step_seconds_count %llu\n", (unsigned long long)cumulative);
+	bool ok = (ferror(f)==0);
+	if(fclose(f)!=0) ok = false;
+	if(!ok)
+	{
+		remove(tempPath);
+		return false;
+	}
+
+	//rename replaces the old file in one step
+#ifdef _WIN32
+	return MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+	return rename(tempPath, path)==0;
+#endif
+}
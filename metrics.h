@@ -0,0 +1,83 @@
+/*-----------------------------------------------------------
+  Metrics Header File
+  Counters on the simulation's hot paths, for the ops
+  dashboards. Each thread adds to a shard of its own, so the
+  counting threads never share a cache line or take a lock;
+  a background thread sums the shards now and then and
+  writes them in the Prometheus text format for
+  node-exporter's textfile collector. The file is written
+  to a temporary name and renamed over the old one, so a
+  scrape never sees half of it.
+  -----------------------------------------------------------*/
+#ifndef metrics_h_included
+#define metrics_h_included
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define METRICS_SHARDS			(64)	//threads counting at once, more share the last one
+#define METRICS_LATENCY_BUCKETS	(14)	//step latency, the last is +Inf
+#define METRICS_LATENCY_SAMPLE	(16)	//one step in this many is timed
+#define METRICS_INTERVAL_MS		(5000)
+#define METRICS_PATH_MAX		(256)
+#define METRICS_ENV				"POOL_METRICS"	//path of the .prom file, any mode
+
+enum metricCounter
+{
+	METRIC_STEPS,				//table steps that moved a ball
+	METRIC_PAIR_TESTS,			//ball pairs given to the narrowphase
+	METRIC_BALL_HITS,
+	METRIC_CUSHION_HITS,
+	METRIC_FIREWORKS,
+	METRIC_PARTICLES_SPAWNED,
+	METRIC_PARTICLES_RECLAIMED,	//particles that hit the ground
+	NUM_METRIC_COUNTERS,
+};
+
+/*-----------------------------------------------------------
+  counting, from any thread
+  -----------------------------------------------------------*/
+void MetricAdd(metricCounter c, uint64_t n = 1);
+//a table step that moved a ball, with what it found
+void MetricTableStep(uint64_t pairTests, uint64_t ballHits, uint64_t cushionHits);
+//a timed table step, one in METRICS_LATENCY_SAMPLE
+void MetricStepLatency(uint64_t ns);
+
+/*-----------------------------------------------------------
+  metricsExporter class
+  -----------------------------------------------------------*/
+class metricsExporter
+{
+private:
+	char			path[METRICS_PATH_MAX];
+	char			tempPath[METRICS_PATH_MAX+8];
+	int				intervalMs;
+	std::mutex		lock;
+	std::condition_variable	wake;
+	bool			stopping;
+	std::thread		writer;
+	std::mutex		writing;		//one Write at a time, they share tempPath
+
+	void WriterLoop(void);
+
+public:
+	metricsExporter():intervalMs(METRICS_INTERVAL_MS),stopping(false) {path[0] = tempPath[0] = 0;}
+	~metricsExporter() {Stop();}
+
+	//write to file every interval until Stop
+	bool Start(const char *file, int ms = METRICS_INTERVAL_MS);
+	//write once more and stop the thread
+	void Stop(void);
+	bool Running(void) const {return writer.joinable();}
+	//sum the shards and write them now
+	bool Write(void);
+};
+
+extern metricsExporter gMetrics;
+
+#endif
@@ -0,0 +1,69 @@
+/*-----------------------------------------------------------
+  Narrowphase Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"simulation.h"
+
+/*-----------------------------------------------------------
+  macros
+  -----------------------------------------------------------*/
+//slack added to the float tests so that rounding can only
+//produce extra candidates, never lose a real hit
+#define NARROWPHASE_SLACK	(1.0e-4f)
+
+/*-----------------------------------------------------------
+  narrowPhase class members
+  -----------------------------------------------------------*/
+void narrowPhase::Grow(int n)
+{
+	dx.resize(n); dz.resize(n);
+	dvx.resize(n); dvz.resize(n);
+	rsum.resize(n);
+	pairs.resize(n);
+}
+
+int narrowPhase::Test(ballPair *hits) const
+{
+	int numHits = 0;
+	int k = 0;
+
+#if VECMATH_SSE
+	const __m128 slack = _mm_set1_ps(NARROWPHASE_SLACK);
+	for(;k+4<=count;k+=4)
+	{
+		//four pairs, one load per component
+		__m128 x = _mm_loadu_ps(&dx[k]);
+		__m128 z = _mm_loadu_ps(&dz[k]);
+		__m128 vx = _mm_loadu_ps(&dvx[k]);
+		__m128 vz = _mm_loadu_ps(&dvz[k]);
+		__m128 r = _mm_add_ps(_mm_loadu_ps(&rsum[k]), slack);
+
+		//touching : |d|^2 <= (r1+r2)^2
+		__m128 dist2 = _mm_add_ps(_mm_mul_ps(x,x),_mm_mul_ps(z,z));
+		__m128 touching = _mm_cmple_ps(dist2,_mm_mul_ps(r,r));
+		//approaching : d.dv < 0
+		__m128 closing = _mm_add_ps(_mm_mul_ps(x,vx),_mm_mul_ps(z,vz));
+		__m128 approaching = _mm_cmplt_ps(closing,slack);
+
+		int mask = _mm_movemask_ps(_mm_and_ps(touching,approaching));
+		//compact the hits, keeping pair order
+		while(mask)
+		{
+			int lane = 0;
+			while(!(mask & (1<<lane))) lane++;
+			hits[numHits++] = pairs[k+lane];
+			mask &= ~(1<<lane);
+		}
+	}
+#endif
+
+	//remaining pairs (or all of them without SSE)
+	for(;k<count;k++)
+	{
+		float r = rsum[k]+NARROWPHASE_SLACK;
+		if((dx[k]*dx[k] + dz[k]*dz[k]) > r*r) continue;
+		if((dx[k]*dvx[k] + dz[k]*dvz[k]) >= NARROWPHASE_SLACK) continue;
+		hits[numHits++] = pairs[k];
+	}
+	return numHits;
+}
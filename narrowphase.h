@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------
+  Narrowphase Header File
+  -----------------------------------------------------------*/
+#ifndef narrowphase_h_included
+#define narrowphase_h_included
+
+#include <vector>
+
+/*-----------------------------------------------------------
+  ball pair : indices of two balls in the table's ball array
+  -----------------------------------------------------------*/
+struct ballPair
+{
+	int a;
+	int b;
+};
+
+/*-----------------------------------------------------------
+  narrowPhase class
+  Filters a list of candidate pairs (from a broadphase, or
+  every pair on a small table) down to the ones that are
+  touching and approaching. The broadphase adds each pair
+  with its relative position and velocity while it has the
+  two balls in hand, and they are stored one array per
+  component in pair order, so the test reads four pairs
+  with each SSE load instead of gathering them ball by
+  ball. Squared distances are compared, so no square roots
+  are taken. The test is conservative : the hits it returns
+  are confirmed in double precision by ball::HasHitBall
+  before they are resolved.
+  -----------------------------------------------------------*/
+class narrowPhase
+{
+private:
+	//the pairs added since Clear, in single precision. The arrays
+	//are sized ahead of need and only grow
+	std::vector<float> dx;
+	std::vector<float> dz;
+	std::vector<float> dvx;
+	std::vector<float> dvz;
+	std::vector<float> rsum;
+	std::vector<ballPair> pairs;
+	int count;
+
+	void Grow(int n);
+
+public:
+	narrowPhase():count(0) {}
+
+	//room for n pairs without allocating
+	void Reserve(int n) {if(n>(int)pairs.size()) Grow(n);}
+	void Clear(void) {count = 0;}
+	int Count(void) const {return count;}
+	//what the arrays hold on the heap
+	size_t HeapBytes(void) const {return pairs.capacity()*(5*sizeof(float) + sizeof(ballPair));}
+	//a candidate pair : a's position and velocity less b's, and
+	//their radii added
+	void Add(int a, int b, double rx, double rz, double rvx, double rvz, float radii)
+	{
+		if(count==(int)pairs.size()) Grow(count*2 + 16);
+		dx[count] = (float)rx;
+		dz[count] = (float)rz;
+		dvx[count] = (float)rvx;
+		dvz[count] = (float)rvz;
+		rsum[count] = radii;
+		pairs[count].a = a;
+		pairs[count].b = b;
+		count++;
+	}
+	//writes the pairs that hit into hits (which must have room
+	//for Count() entries), preserving their order, and returns
+	//how many there were
+	int Test(ballPair *hits) const;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*-----------------------------------------------------------
+  Offscreen Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"offscreen.h"
+#include <string.h>
+
+#if OFFSCREEN_AVAILABLE
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+/*-----------------------------------------------------------
+  offscreenContext class members
+  -----------------------------------------------------------*/
+offscreenContext::offscreenContext():display(0),context(0),surface(0),fbo(0),colour(0),depth(0),width(0),height(0)
+{
+	error[0] = 0;
+}
+
+offscreenContext::~offscreenContext()
+{
+	Destroy();
+}
+
+bool offscreenContext::Fail(const char *what)
+{
+	strncpy(error, what, sizeof(error)-1);
+	error[sizeof(error)-1] = 0;
+	Destroy();
+	return false;
+}
+
+#if OFFSCREEN_AVAILABLE
+
+bool offscreenContext::Create(int w, int h)
+{
+	Destroy();
+	width = w;
+	height = h;
+
+	//surfaceless needs no display server; fall back to the default
+	//display for EGL builds without it
+	EGLDisplay d = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(getPlatformDisplay) d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	if(d==EGL_NO_DISPLAY) d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(d==EGL_NO_DISPLAY || !eglInitialize(d, 0, 0)) return Fail("no EGL display");
+	display = d;
+	if(!eglBindAPI(EGL_OPENGL_API)) return Fail("EGL has no desktop OpenGL");
+
+	//a pbuffer config if there is one, otherwise any desktop GL config
+	EGLint attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	bool pbuffer = eglChooseConfig(d, attribs, &config, 1, &numConfigs) && numConfigs>0;
+	if(!pbuffer)
+	{
+		attribs[1] = 0;
+		if(!eglChooseConfig(d, attribs, &config, 1, &numConfigs) || numConfigs==0) return Fail("no EGL config for desktop OpenGL");
+	}
+
+	EGLContext c = eglCreateContext(d, config, EGL_NO_CONTEXT, 0);
+	if(c==EGL_NO_CONTEXT) return Fail("could not create an EGL context");
+	context = c;
+
+	if(pbuffer)
+	{
+		EGLint size[] = {EGL_WIDTH, w, EGL_HEIGHT, h, EGL_NONE};
+		EGLSurface s = eglCreatePbufferSurface(d, config, size);
+		if(s!=EGL_NO_SURFACE) surface = s;
+	}
+	EGLSurface s = surface ? (EGLSurface)surface : EGL_NO_SURFACE;
+	if(!eglMakeCurrent(d, s, s, c)) return Fail("could not make the EGL context current");
+	if(surface)
+	{
+		snprintf(error, sizeof(error), "EGL pbuffer %dx%d, %s", w, h, (const char *)glGetString(GL_RENDERER));
+		return true;
+	}
+
+	//no pbuffer : draw into a framebuffer object instead
+	PFNGLGENFRAMEBUFFERSPROC genFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)eglGetProcAddress("glGenFramebuffers");
+	PFNGLBINDFRAMEBUFFERPROC bindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)eglGetProcAddress("glBindFramebuffer");
+	PFNGLGENRENDERBUFFERSPROC genRenderbuffers = (PFNGLGENRENDERBUFFERSPROC)eglGetProcAddress("glGenRenderbuffers");
+	PFNGLBINDRENDERBUFFERPROC bindRenderbuffer = (PFNGLBINDRENDERBUFFERPROC)eglGetProcAddress("glBindRenderbuffer");
+	PFNGLRENDERBUFFERSTORAGEPROC renderbufferStorage = (PFNGLRENDERBUFFERSTORAGEPROC)eglGetProcAddress("glRenderbufferStorage");
+	PFNGLFRAMEBUFFERRENDERBUFFERPROC framebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)eglGetProcAddress("glFramebufferRenderbuffer");
+	PFNGLCHECKFRAMEBUFFERSTATUSPROC checkFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)eglGetProcAddress("glCheckFramebufferStatus");
+	if(!genFramebuffers || !bindFramebuffer || !genRenderbuffers || !bindRenderbuffer ||
+		!renderbufferStorage || !framebufferRenderbuffer || !checkFramebufferStatus) return Fail("no pbuffer and no framebuffer objects");
+
+	genRenderbuffers(1, &colour);
+	bindRenderbuffer(GL_RENDERBUFFER, colour);
+	renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+	genRenderbuffers(1, &depth);
+	bindRenderbuffer(GL_RENDERBUFFER, depth);
+	renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	genFramebuffers(1, &fbo);
+	bindFramebuffer(GL_FRAMEBUFFER, fbo);
+	framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+	framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	if(checkFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE) return Fail("framebuffer object incomplete");
+	snprintf(error, sizeof(error), "EGL surfaceless fbo %dx%d, %s", w, h, (const char *)glGetString(GL_RENDERER));
+	return true;
+}
+
+void offscreenContext::Destroy(void)
+{
+	if(!display) return;
+	EGLDisplay d = (EGLDisplay)display;
+	if(context && (fbo || colour || depth))
+	{
+		PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)eglGetProcAddress("glDeleteFramebuffers");
+		PFNGLDELETERENDERBUFFERSPROC deleteRenderbuffers = (PFNGLDELETERENDERBUFFERSPROC)eglGetProcAddress("glDeleteRenderbuffers");
+		if(deleteFramebuffers && fbo) deleteFramebuffers(1, &fbo);
+		if(deleteRenderbuffers && colour) deleteRenderbuffers(1, &colour);
+		if(deleteRenderbuffers && depth) deleteRenderbuffers(1, &depth);
+	}
+	fbo = colour = depth = 0;
+	eglMakeCurrent(d, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if(surface) eglDestroySurface(d, (EGLSurface)surface);
+	if(context) eglDestroyContext(d, (EGLContext)context);
+	eglTerminate(d);
+	display = context = surface = 0;
+}
+
+#else
+
+bool offscreenContext::Create(int w, int h)
+{
+	width = w;
+	height = h;
+	return Fail("offscreen rendering needs an EGL (Mesa) build");
+}
+
+void offscreenContext::Destroy(void)
+{
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*-----------------------------------------------------------
+  Offscreen Header File
+  An OpenGL context with no window, for rendering on machines
+  with no display or GPU : EGL on Mesa's surfaceless platform
+  (software rendering when there is no GPU), drawing into a
+  pbuffer or, where pbuffers are missing, a framebuffer
+  object. The context is a compatibility one, so the game's
+  immediate mode drawing runs unchanged.
+  -----------------------------------------------------------*/
+#ifndef offscreen_h_included
+#define offscreen_h_included
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#ifdef _WIN32
+#define OFFSCREEN_AVAILABLE	(0)		//EGL is a Linux (Mesa) build option
+#else
+#define OFFSCREEN_AVAILABLE	(1)
+#endif
+
+/*-----------------------------------------------------------
+  offscreenContext class
+  -----------------------------------------------------------*/
+class offscreenContext
+{
+private:
+	void			*display;
+	void			*context;
+	void			*surface;	//pbuffer, or 0 when drawing to fbo
+	unsigned int	fbo;
+	unsigned int	colour;
+	unsigned int	depth;
+	int				width;
+	int				height;
+	char			error[128];
+
+	bool Fail(const char *what);
+
+public:
+	offscreenContext();
+	~offscreenContext();
+
+	//create the context and make it current on this thread
+	bool Create(int w, int h);
+	void Destroy(void);
+
+	int Width(void) const {return width;}
+	int Height(void) const {return height;}
+	//which backend was used, or why Create failed
+	const char *Description(void) const {return error;}
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*-----------------------------------------------------------
+  Pool Simulation C Interface Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"poolsim.h"
+#include"simulation.h"
+#include <vector>
+
+/*-----------------------------------------------------------
+  the handle : a table, and packed copies of its positions and
+  velocities that are brought up to date after every call that
+  changes the table
+  -----------------------------------------------------------*/
+struct poolsim_table
+{
+	table				t;
+	std::vector<double>	positions;	//x0 z0 x1 z1 ...
+	std::vector<double>	velocities;
+	unsigned int		synced;		//table version the arrays hold
+
+	poolsim_table(int numBalls, tableLayout layout, unsigned int seed):t(numBalls, layout, seed),
+		positions(numBalls*2),velocities(numBalls*2),synced(t.Version()-1) {Sync();}
+
+	void Sync(void)
+	{
+		if(synced==t.Version()) return;
+		for(int i=0;i<t.NumBalls();i++)
+		{
+			positions[i*2] = t.balls[i].position(0);
+			positions[i*2+1] = t.balls[i].position(1);
+			velocities[i*2] = t.balls[i].velocity(0);
+			velocities[i*2+1] = t.balls[i].velocity(1);
+		}
+		synced = t.Version();
+	}
+};
+
+static bool ValidBall(const poolsim_table *t, int ball)
+{
+	return t && ball>=0 && ball<t->t.NumBalls();
+}
+
+int poolsim_api_version(void)
+{
+	return POOLSIM_API_VERSION;
+}
+
+/*-----------------------------------------------------------
+  tables
+  -----------------------------------------------------------*/
+poolsim_table *poolsim_create(void)
+{
+	return new poolsim_table(NUM_BALLS, LAYOUT_RACK, 0);
+}
+
+poolsim_table *poolsim_create_sized(int numBalls, int layout, unsigned int seed)
+{
+	if(numBalls<1) return 0;
+	if(layout!=POOLSIM_LAYOUT_RACK && layout!=POOLSIM_LAYOUT_SCATTER) return 0;
+	return new poolsim_table(numBalls, (layout==POOLSIM_LAYOUT_RACK) ? LAYOUT_RACK : LAYOUT_SCATTER, seed);
+}
+
+void poolsim_destroy(poolsim_table *t)
+{
+	delete t;
+}
+
+int poolsim_num_balls(const poolsim_table *t)
+{
+	if(!t) return POOLSIM_ERR_ARG;
+	return t->t.NumBalls();
+}
+
+int poolsim_reset(poolsim_table *t)
+{
+	if(!t) return POOLSIM_ERR_ARG;
+	t->t.Reset();
+	t->Sync();
+	return POOLSIM_OK;
+}
+
+/*-----------------------------------------------------------
+  state
+  -----------------------------------------------------------*/
+const double *poolsim_positions(const poolsim_table *t, int *stride)
+{
+	if(!t) return 0;
+	if(stride) *stride = 2;
+	return &t->positions[0];
+}
+
+const double *poolsim_velocities(const poolsim_table *t, int *stride)
+{
+	if(!t) return 0;
+	if(stride) *stride = 2;
+	return &t->velocities[0];
+}
+
+int poolsim_set_ball(poolsim_table *t, int ball, double x, double z, double vx, double vz)
+{
+	if(!ValidBall(t, ball)) return POOLSIM_ERR_ARG;
+	t->t.SetBall(ball, vec2(x, z), vec2(vx, vz));
+	t->Sync();
+	return POOLSIM_OK;
+}
+
+int poolsim_set_state(poolsim_table *t, const double *positions, const double *velocities)
+{
+	if(!t || !positions || !velocities) return POOLSIM_ERR_ARG;
+	for(int i=0;i<t->t.NumBalls();i++)
+		t->t.SetBall(i, vec2(positions[i*2], positions[i*2+1]), vec2(velocities[i*2], velocities[i*2+1]));
+	t->Sync();
+	return POOLSIM_OK;
+}
+
+int poolsim_apply_impulse(poolsim_table *t, int ball, double ix, double iz)
+{
+	if(!ValidBall(t, ball)) return POOLSIM_ERR_ARG;
+	t->t.ApplyImpulse(ball, vec2(ix, iz));
+	t->Sync();
+	return POOLSIM_OK;
+}
+
+int poolsim_moving(const poolsim_table *t)
+{
+	if(!t) return POOLSIM_ERR_ARG;
+	return t->t.NumActive();
+}
+
+uint64_t poolsim_state_hash(const poolsim_table *t)
+{
+	if(!t) return 0;
+	return t->t.StateHash();
+}
+
+/*-----------------------------------------------------------
+  stepping
+  -----------------------------------------------------------*/
+int poolsim_step_ms(void)
+{
+	return SIM_UPDATE_MS;
+}
+
+int poolsim_step(poolsim_table *t, int ms)
+{
+	if(!t || ms<0) return POOLSIM_ERR_ARG;
+	for(int i=0;i<ms/SIM_UPDATE_MS;i++) t->t.Update(SIM_UPDATE_MS);
+	if(ms%SIM_UPDATE_MS) t->t.Update(ms%SIM_UPDATE_MS);
+	t->Sync();
+	return POOLSIM_OK;
+}
+
+int poolsim_step_to_rest(poolsim_table *t, int maxSteps, int *steps)
+{
+	if(!t || maxSteps<0) return POOLSIM_ERR_ARG;
+	int n = 0;
+	while(n<maxSteps && t->t.AnyBallsMoving())
+	{
+		t->t.Update(SIM_UPDATE_MS);
+		n++;
+	}
+	if(steps) *steps = n;
+	t->Sync();
+	return t->t.AnyBallsMoving() ? POOLSIM_ERR_NOT_AT_REST : POOLSIM_OK;
+}
+
+/*-----------------------------------------------------------
+  batches
+  -----------------------------------------------------------*/
+static int Collect(int r, int i, int *results, int first)
+{
+	if(results) results[i] = r;
+	return (first==POOLSIM_OK) ? r : first;
+}
+
+int poolsim_step_batch(poolsim_table *const *tables, int count, int ms, int *results)
+{
+	if(!tables || count<0) return POOLSIM_ERR_ARG;
+	int r = POOLSIM_OK;
+	for(int i=0;i<count;i++) r = Collect(poolsim_step(tables[i], ms), i, results, r);
+	return r;
+}
+
+int poolsim_step_to_rest_batch(poolsim_table *const *tables, int count, int maxSteps, int *steps, int *results)
+{
+	if(!tables || count<0) return POOLSIM_ERR_ARG;
+	int r = POOLSIM_OK;
+	for(int i=0;i<count;i++) r = Collect(poolsim_step_to_rest(tables[i], maxSteps, steps ? &steps[i] : 0), i, results, r);
+	return r;
+}
+
+int poolsim_apply_impulse_batch(poolsim_table *const *tables, int count, int ball, const double *impulses, int *results)
+{
+	if(!tables || !impulses || count<0) return POOLSIM_ERR_ARG;
+	int r = POOLSIM_OK;
+	for(int i=0;i<count;i++) r = Collect(poolsim_apply_impulse(tables[i], ball, impulses[i*2], impulses[i*2+1]), i, results, r);
+	return r;
+}
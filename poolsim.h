@@ -0,0 +1,112 @@
+/*-----------------------------------------------------------
+  Pool Simulation C Interface
+  A plain C ABI over the table simulation, for embedding the
+  engine in other languages. Tables are opaque handles; all
+  functions are extern "C" and take only C types, so the
+  layout of the engine's classes is free to change without
+  breaking callers.
+
+  The interface is versioned : POOLSIM_API_VERSION is bumped
+  on any incompatible change, and callers should check
+  poolsim_api_version() against the header they compiled
+  with. New functions may be added within a version.
+  -----------------------------------------------------------*/
+#ifndef poolsim_h_included
+#define poolsim_h_included
+
+#include <stdint.h>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define POOLSIM_API_VERSION		(1)
+
+#if defined(_WIN32)
+	#if defined(POOLSIM_EXPORTS)
+		#define POOLSIM_API		__declspec(dllexport)
+	#else
+		#define POOLSIM_API		__declspec(dllimport)
+	#endif
+#else
+	#define POOLSIM_API		__attribute__((visibility("default")))
+#endif
+
+//return codes
+#define POOLSIM_OK				(0)
+#define POOLSIM_ERR_ARG			(-1)	//null handle or index out of range
+#define POOLSIM_ERR_NOT_AT_REST	(-2)	//step cap reached with balls still moving
+
+//layouts for poolsim_create_sized
+#define POOLSIM_LAYOUT_RACK		(0)		//cue ball and a triangle rack
+#define POOLSIM_LAYOUT_SCATTER	(1)		//random, non-overlapping
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct poolsim_table poolsim_table;
+
+POOLSIM_API int poolsim_api_version(void);
+
+/*-----------------------------------------------------------
+  tables
+  a new table is racked and at rest; poolsim_create gives the
+  standard game and poolsim_create_sized any number of balls,
+  on a cloth scaled up to fit them. Tables are independent,
+  so different tables may be used from different threads;
+  one table must not be used from two threads at once
+  -----------------------------------------------------------*/
+POOLSIM_API poolsim_table *poolsim_create(void);
+POOLSIM_API poolsim_table *poolsim_create_sized(int numBalls, int layout, unsigned int seed);
+POOLSIM_API void poolsim_destroy(poolsim_table *t);
+POOLSIM_API int poolsim_num_balls(const poolsim_table *t);
+POOLSIM_API int poolsim_reset(poolsim_table *t);
+
+/*-----------------------------------------------------------
+  state
+  positions and velocities are (x, z) pairs in metres and
+  metres per second. The read accessors return densely packed
+  arrays owned by the engine, valid until the table is
+  destroyed and current after every call that changes it :
+  ball i is at p[i*2] and p[i*2+1]. stride, if not null, gets
+  2 (it is kept for callers written against a strided
+  layout). They are read only; change state through
+  poolsim_set_ball or poolsim_set_state so the engine can
+  track which balls are moving
+  -----------------------------------------------------------*/
+POOLSIM_API const double *poolsim_positions(const poolsim_table *t, int *stride);
+POOLSIM_API const double *poolsim_velocities(const poolsim_table *t, int *stride);
+POOLSIM_API int poolsim_set_ball(poolsim_table *t, int ball, double x, double z, double vx, double vz);
+//positions and velocities : poolsim_num_balls(t)*2 doubles each
+POOLSIM_API int poolsim_set_state(poolsim_table *t, const double *positions, const double *velocities);
+POOLSIM_API int poolsim_apply_impulse(poolsim_table *t, int ball, double ix, double iz);
+POOLSIM_API int poolsim_moving(const poolsim_table *t);
+POOLSIM_API uint64_t poolsim_state_hash(const poolsim_table *t);
+
+/*-----------------------------------------------------------
+  stepping
+  time advances in the engine's fixed step; poolsim_step runs
+  ms/step_ms whole steps and then one step of the remainder.
+  poolsim_step_to_rest steps until no ball moves or maxSteps
+  is reached, and writes the number of steps taken
+  -----------------------------------------------------------*/
+POOLSIM_API int poolsim_step_ms(void);
+POOLSIM_API int poolsim_step(poolsim_table *t, int ms);
+POOLSIM_API int poolsim_step_to_rest(poolsim_table *t, int maxSteps, int *steps);
+
+/*-----------------------------------------------------------
+  batches
+  the same as calling the single table function on each
+  handle in turn, in one call. results, if not null, gets one
+  return code per table; the function returns POOLSIM_OK if
+  every table did, else the first failure
+  -----------------------------------------------------------*/
+POOLSIM_API int poolsim_step_batch(poolsim_table *const *tables, int count, int ms, int *results);
+POOLSIM_API int poolsim_step_to_rest_batch(poolsim_table *const *tables, int count, int maxSteps, int *steps, int *results);
+POOLSIM_API int poolsim_apply_impulse_batch(poolsim_table *const *tables, int count, int ball, const double *impulses, int *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
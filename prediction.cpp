@@ -0,0 +1,179 @@
+/*-----------------------------------------------------------
+  Prediction Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"prediction.h"
+
+/*-----------------------------------------------------------
+  friction profile
+  ball::Update applies a fixed speed loss per step and then
+  moves, so after m moving steps the distance covered is
+	d(m) = dt * (m*s0 - delta*m*(m+1)/2)
+  which can be summed and inverted in closed form
+  -----------------------------------------------------------*/
+struct frictionProfile
+{
+	double s0;			//initial speed
+	double delta;		//speed lost per step
+	double dt;			//seconds per step
+	int movingSteps;	//steps that move the ball
+	int restSteps;		//steps until the velocity is zeroed
+	bool endsSlow;		//the last moving step ends under SMALL_VELOCITY, and is zeroed
+
+	frictionProfile(double speed, int ms)
+	{
+		s0 = speed;
+		delta = ((gCoeffFriction * gGravityAccn) * ms)/1000.0f;
+		dt = ms/1000.0f;
+		if(s0<=0.0)
+		{
+			movingSteps = restSteps = 0;
+			endsSlow = true;
+			return;
+		}
+		//first step that ends below SMALL_VELOCITY
+		int k = (s0<SMALL_VELOCITY || delta<=0.0) ? 1 : (int)floor((s0-SMALL_VELOCITY)/delta)+1;
+		//first step where the friction change would overshoot, that
+		//step zeroes the velocity without moving
+		int m = (delta<=0.0) ? k+1 : (int)floor(s0/delta)+1;
+		if(m<=k)
+		{
+			movingSteps = m-1;
+			restSteps = m;
+			endsSlow = false;
+		}
+		else
+		{
+			movingSteps = restSteps = k;
+			endsSlow = true;
+		}
+	}
+
+	double SpeedAfter(int m) const
+	{
+		//the last moving step still has its speed, unless that step
+		//took it under SMALL_VELOCITY
+		if(m>movingSteps || (m==movingSteps && endsSlow)) return 0.0;
+		return s0 - (delta*m);
+	}
+
+	double Distance(int m) const
+	{
+		return dt*((m*s0) - (delta*m*(m+1))/2.0);
+	}
+
+	//fewest moving steps that cover len, or -1 if the ball stops first
+	int StepsToTravel(double len) const
+	{
+		if(len<=0.0) return 0;
+		if(movingSteps==0) return -1;
+		double m;
+		if(delta<=0.0) m = len/(dt*s0);
+		else
+		{
+			//solve delta/2 m^2 - (s0 - delta/2) m + len/dt = 0 for the smaller root
+			double b = s0 - (delta/2.0);
+			double disc = (b*b) - ((2.0*delta*len)/dt);
+			if(disc<0.0) return -1;
+			m = (b - sqrt(disc))/delta;
+		}
+		int steps = (int)ceil(m);
+		if(steps<1) steps = 1;
+		//guard the rounding at the boundary
+		if(steps>1 && Distance(steps-1)>=len) steps--;
+		if(steps>movingSteps) return -1;
+		return steps;
+	}
+};
+
+/*-----------------------------------------------------------
+  prediction functions
+  -----------------------------------------------------------*/
+void PredictBall(const table &t, int i, ballPrediction &out, int ms)
+{
+	PredictBall(t, i, t.balls[i].velocity, out, ms);
+}
+
+void PredictBall(const table &t, int i, const vec2 &v, ballPrediction &out, int ms)
+{
+	const ball &b = t.balls[i];
+	double speed = v.Magnitude();
+	frictionProfile profile(speed, ms);
+
+	out.restSteps = profile.restSteps;
+	out.restTime = profile.restSteps*ms;
+	out.direction = (speed>0.0) ? v/speed : vec2(0.0);
+	out.restPos = b.position + out.direction*profile.Distance(profile.movingSteps);
+	out.contactType = CONTACT_NONE;
+	out.contactIndex = -1;
+	out.contactSteps = -1;
+	out.contactTime = -1;
+	out.contactPos = out.restPos;
+	out.contactVelocity = vec2(0.0);
+	if(speed<=0.0) return;
+
+	const vec2 &dir = out.direction;
+	double best = -1.0;
+
+	//cushions : distance along the path to where the ball is within a
+	//radius of the (infinite) cushion line, as in ball::HasHitPlane
+	for(int c=0;c<NUM_CUSHION;c++)
+	{
+		const cushion &cu = t.cushions[c];
+		double closing = dir.Dot(cu.normal);
+		if(closing>=0.0) continue;
+		double gap = (b.position - cu.end).Dot(cu.normal) - b.radius;
+		double len = (gap>0.0) ? gap/(-closing) : 0.0;
+		if(best<0.0 || len<best)
+		{
+			best = len;
+			out.contactType = CONTACT_CUSHION;
+			out.contactIndex = c;
+		}
+	}
+
+	//balls : first point on the ray within the sum of the radii
+	for(int j=0;j<t.NumBalls();j++)
+	{
+		if(j==i) continue;
+		const ball &o = t.balls[j];
+		vec2 rel = b.position - o.position;
+		double along = rel.Dot(dir);
+		if(along>=0.0) continue;
+		double sumRadii = b.radius + o.radius;
+		double c = rel.Magnitude2() - (sumRadii*sumRadii);
+		double len;
+		if(c<=0.0) len = 0.0;
+		else
+		{
+			double disc = (along*along) - c;
+			if(disc<0.0) continue;
+			len = -along - sqrt(disc);
+		}
+		if(best<0.0 || len<best)
+		{
+			best = len;
+			out.contactType = CONTACT_BALL;
+			out.contactIndex = j;
+		}
+	}
+
+	if(out.contactType==CONTACT_NONE) return;
+	int steps = profile.StepsToTravel(best);
+	if(steps<0)
+	{
+		//stops before it gets there
+		out.contactType = CONTACT_NONE;
+		out.contactIndex = -1;
+		return;
+	}
+	out.contactSteps = steps;
+	out.contactTime = steps*ms;
+	out.contactPos = b.position + dir*profile.Distance(steps);
+	out.contactVelocity = dir*profile.SpeedAfter(steps);
+}
+
+void PredictTable(const table &t, ballPrediction *out, int ms)
+{
+	for(int i=0;i<t.NumBalls();i++) PredictBall(t, i, out[i], ms);
+}
@@ -0,0 +1,55 @@
+/*-----------------------------------------------------------
+  Prediction Header File
+  Closed form fast forward of single ball motion under the
+  constant friction model, without stepping the table.
+  -----------------------------------------------------------*/
+#ifndef prediction_h_included
+#define prediction_h_included
+
+#include"simulation.h"
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define CONTACT_NONE		(0)
+#define CONTACT_CUSHION		(1)
+#define CONTACT_BALL		(2)
+
+/*-----------------------------------------------------------
+  ballPrediction : where and when a ball comes to rest, and
+  the first thing it touches on the way
+  Times are whole simulation steps (and ms) so they line up
+  with what table::Update would produce.
+  -----------------------------------------------------------*/
+struct ballPrediction
+{
+	int		restSteps;		//steps until the velocity is zeroed
+	int		restTime;		//ms
+	vec2	restPos;
+	vec2	direction;		//unit direction of travel (zero if at rest)
+
+	int		contactType;	//CONTACT_NONE, CONTACT_CUSHION or CONTACT_BALL
+	int		contactIndex;	//cushion or ball index
+	int		contactSteps;	//steps moved before the contact is detected
+	int		contactTime;	//ms
+	vec2	contactPos;		//ball centre when the contact is detected
+	vec2	contactVelocity;	//and its velocity at that point
+};
+
+//a ball's path if it were alone on the table : it moves in a
+//straight line and stops, the other balls are treated as fixed at
+//their current positions when looking for the first ball contact.
+//the result matches stepping the table with SIM_UPDATE_MS steps up
+//to rounding while the ball moves at most CCD_MAX_TRAVEL a step
+//(5 m/s at 10 ms). Faster than that the table moves it in sub-steps,
+//which shed speed as they go and so cover a little more ground : up
+//to half a step's friction loss times the step, about 15 um a step at
+//10 ms, until it slows to that speed. Its speeds and rest step still
+//match, but the table puts it slightly ahead of the predicted path
+void PredictBall(const table &t, int i, ballPrediction &out, int ms = SIM_UPDATE_MS);
+//as above, but as if ball i had been given velocity v
+void PredictBall(const table &t, int i, const vec2 &v, ballPrediction &out, int ms = SIM_UPDATE_MS);
+//every ball on the table, out must have room for t.NumBalls() entries
+void PredictTable(const table &t, ballPrediction *out, int ms = SIM_UPDATE_MS);
+
+#endif
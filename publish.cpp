@@ -0,0 +1,281 @@
+/*-----------------------------------------------------------
+  Publish Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"publish.h"
+#include <string.h>
+#include <new>
+#include <thread>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*-----------------------------------------------------------
+  sharedMapping class members
+  -----------------------------------------------------------*/
+bool sharedMapping::Create(const char *n, size_t bytes, bool replace)
+{
+	Close();
+	owner = true;
+#ifdef _WIN32
+	sprintf(name, "Local\\%s", n);
+	HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0, (DWORD)bytes, name);
+	if(!h) return false;
+	handle = h;
+	//a mapping lives while any process has it open, so replacing one
+	//means taking it over
+	if(GetLastError()==ERROR_ALREADY_EXISTS && !replace)
+	{
+		Close();
+		return false;
+	}
+	base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+#else
+	sprintf(name, "/%s", n);
+	if(replace) shm_unlink(name);
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd<0)
+	{
+		//don't unlink a name that belongs to someone else
+		name[0] = 0;
+		return false;
+	}
+	if(ftruncate(fd, bytes)!=0)
+	{
+		close(fd);
+		return false;
+	}
+	base = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base==MAP_FAILED) base = 0;
+#endif
+	size = bytes;
+	if(!base) Close();
+	return base!=0;
+}
+
+bool sharedMapping::Open(const char *n, size_t bytes)
+{
+	Close();
+	owner = false;
+#ifdef _WIN32
+	sprintf(name, "Local\\%s", n);
+	HANDLE h = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+	if(!h) return false;
+	handle = h;
+	base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+#else
+	sprintf(name, "/%s", n);
+	//readers map read-write only because std::atomic loads are not
+	//guaranteed to work on read-only pages; they never store
+	int fd = shm_open(name, O_RDWR, 0);
+	if(fd<0) return false;
+	base = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base==MAP_FAILED) base = 0;
+#endif
+	size = bytes;
+	if(!base) Close();
+	return base!=0;
+}
+
+void sharedMapping::Close(void)
+{
+#ifdef _WIN32
+	if(base) UnmapViewOfFile(base);
+	if(handle) CloseHandle((HANDLE)handle);
+#else
+	if(base) munmap(base, size);
+	if(owner && name[0]) shm_unlink(name);
+#endif
+	handle = 0;
+	base = 0;
+	size = 0;
+}
+
+/*-----------------------------------------------------------
+  statePublisher class members
+  -----------------------------------------------------------*/
+bool statePublisher::Open(int maxBalls, const char *name, bool replace)
+{
+	if(!mapping.Create(name, PublishedRingBytes(maxBalls), replace)) return false;
+	ring = new(mapping.Base()) publishedRing;
+	ring->magic = PUBLISH_MAGIC;
+	ring->version = PUBLISH_VERSION;
+	ring->numSlots = PUBLISH_SLOTS;
+	ring->maxBalls = maxBalls;
+	ring->slotBytes = (uint32_t)PublishedSlotBytes(maxBalls);
+	for(int i=0;i<PUBLISH_SLOTS;i++)
+	{
+		publishedSlot *slot = new(PublishedSlot(ring, i)) publishedSlot;
+		slot->seq.store(0, std::memory_order_relaxed);
+	}
+	ring->head.store(0, std::memory_order_release);
+	step = 0;
+	warned = false;
+	return true;
+}
+
+void statePublisher::Close(void)
+{
+	mapping.Close();
+	ring = 0;
+}
+
+void statePublisher::Publish(const table &t, int liveParticles)
+{
+	if(!ring) return;
+	if(t.NumBalls()>(int)ring->maxBalls)
+	{
+		if(!warned) printf("not publishing : the table has %d balls, the ring was opened for %u\n", t.NumBalls(), ring->maxBalls);
+		warned = true;
+		return;
+	}
+	publishedSlot &slot = *PublishedSlot(ring, step);
+
+	//odd : readers of this slot will retry
+	uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+	slot.seq.store(seq+1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.header.step = step;
+	slot.header.numBalls = t.NumBalls();
+	slot.header.liveParticles = liveParticles;
+	publishedBall *b = PublishedBalls(&slot);
+	for(int i=0;i<t.NumBalls();i++)
+	{
+		b[i].position[0] = t.balls[i].position(0);
+		b[i].position[1] = t.balls[i].position(1);
+		b[i].velocity[0] = t.balls[i].velocity(0);
+		b[i].velocity[1] = t.balls[i].velocity(1);
+	}
+
+	slot.seq.store(seq+2, std::memory_order_release);
+	step++;
+	ring->head.store(step, std::memory_order_release);
+}
+
+/*-----------------------------------------------------------
+  stateReader class members
+  -----------------------------------------------------------*/
+bool stateReader::Open(const char *name)
+{
+	//the header says how big the frames are, then map the whole ring
+	if(!mapping.Open(name, sizeof(publishedRing))) return false;
+	ring = (publishedRing *)mapping.Base();
+	bool ok = ring->magic==PUBLISH_MAGIC && ring->version==PUBLISH_VERSION && ring->numSlots==PUBLISH_SLOTS &&
+		ring->slotBytes==PublishedSlotBytes(ring->maxBalls);
+	int maxBalls = ring->maxBalls;
+	if(ok) ok = mapping.Open(name, PublishedRingBytes(maxBalls));
+	ring = ok ? (publishedRing *)mapping.Base() : 0;
+	if(!ok) Close();
+	return ok;
+}
+
+void stateReader::Close(void)
+{
+	mapping.Close();
+	ring = 0;
+}
+
+bool stateReader::ReadSlot(uint64_t step, publishedFrame &out) const
+{
+	publishedSlot &slot = *PublishedSlot(ring, step);
+	const publishedBall *b = PublishedBalls(&slot);
+	//sized once, so reading never allocates after the first frame
+	out.balls.reserve(ring->maxBalls);
+	//if the writer dies inside the slot its seq stays odd, so give up
+	//after a while rather than spin forever
+	std::chrono::steady_clock::time_point giveUp;
+	bool waiting = false;
+	for(;;)
+	{
+		uint32_t before = slot.seq.load(std::memory_order_acquire);
+		if(before & 1)
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if(!waiting) giveUp = now + std::chrono::milliseconds(PUBLISH_READ_TIMEOUT_MS);
+			else if(now>giveUp) return false;
+			waiting = true;
+			std::this_thread::yield();
+			continue;
+		}
+		out.step = slot.header.step;
+		out.numBalls = slot.header.numBalls;
+		out.liveParticles = slot.header.liveParticles;
+		//a torn count is caught by the seq check, but must not overrun first
+		int n = (out.numBalls<0) ? 0 : (out.numBalls>(int)ring->maxBalls) ? (int)ring->maxBalls : out.numBalls;
+		out.balls.resize(n);
+		if(n) memcpy(&out.balls[0], b, n*sizeof(publishedBall));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t after = slot.seq.load(std::memory_order_relaxed);
+		if(before!=after) continue;
+		//the writer may have lapped us and reused the slot
+		return out.step==step;
+	}
+}
+
+bool stateReader::ReadLatest(publishedFrame &out) const
+{
+	if(!ring) return false;
+	for(;;)
+	{
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		if(head==0) return false;
+		if(ReadSlot(head-1, out)) return true;
+		//lapped : try the new head. timed out : the writer is gone
+		if(ring->head.load(std::memory_order_acquire)==head) return false;
+	}
+}
+
+int stateReader::ReadSince(uint64_t &next, publishedFrame *out, int max) const
+{
+	if(!ring) return 0;
+	uint64_t head = ring->head.load(std::memory_order_acquire);
+	if(head>PUBLISH_SLOTS && next<head-PUBLISH_SLOTS) next = head-PUBLISH_SLOTS;
+	int n = 0;
+	while(next<head && n<max)
+	{
+		//a slot that was overwritten while we read it is skipped
+		if(ReadSlot(next, out[n])) n++;
+		next++;
+	}
+	return n;
+}
+
+/*-----------------------------------------------------------
+  console mode
+  -----------------------------------------------------------*/
+int RunFollower(const char *name)
+{
+	stateReader reader;
+	while(!reader.Open(name))
+	{
+		printf("waiting for %s...\n", name);
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+	publishedFrame frames[16];
+	uint64_t next = 0;
+	publishedFrame latest;
+	if(reader.ReadLatest(latest)) next = latest.step;
+	for(;;)
+	{
+		int n = reader.ReadSince(next, frames, 16);
+		for(int i=0;i<n;i++)
+		{
+			const publishedFrame &f = frames[i];
+			if(f.numBalls==0) continue;
+			printf("step %llu particles %d cue (%.3f, %.3f) v (%.3f, %.3f)\n", (unsigned long long)f.step, f.liveParticles,
+				f.balls[0].position[0], f.balls[0].position[1], f.balls[0].velocity[0], f.balls[0].velocity[1]);
+		}
+		if(n==0) std::this_thread::sleep_for(std::chrono::milliseconds(SIM_UPDATE_MS));
+	}
+	return 0;
+}
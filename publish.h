@@ -0,0 +1,162 @@
+/*-----------------------------------------------------------
+  Publish Header File
+  Each simulation step's ball state goes into a ring in
+  shared memory, so other local processes (spectators,
+  loggers, bots) can follow a game without going through
+  the GLUT process. Slots are versioned with a seqlock : the
+  writer never waits for readers, readers retry a slot that
+  changed under them.
+  -----------------------------------------------------------*/
+#ifndef publish_h_included
+#define publish_h_included
+
+#include"simulation.h"
+#include <atomic>
+#include <vector>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define PUBLISH_NAME		"pool_game_state"
+#define PUBLISH_SLOTS		(64)			//steps a reader can fall behind
+#define PUBLISH_MAGIC		(0x506f6f6cu)	//'Pool'
+#define PUBLISH_VERSION		(3)
+#define PUBLISH_READ_TIMEOUT_MS	(100)		//a writer in a slot this long has died
+
+/*-----------------------------------------------------------
+  shared layout
+  -----------------------------------------------------------*/
+struct publishedBall
+{
+	double	position[2];
+	double	velocity[2];
+};
+
+struct publishedHeader
+{
+	uint64_t		step;
+	int				numBalls;
+	int				liveParticles;
+};
+
+//followed by maxBalls publishedBall, so a slot is slotBytes long
+struct publishedSlot
+{
+	std::atomic<uint32_t>	seq;	//odd while the writer is in the slot
+	uint32_t				pad;
+	publishedHeader			header;
+};
+
+//followed by numSlots slots
+struct publishedRing
+{
+	uint32_t				magic;
+	uint32_t				version;
+	uint32_t				numSlots;
+	uint32_t				maxBalls;	//set from the table when the publisher opens
+	uint32_t				slotBytes;
+	uint32_t				pad;
+	std::atomic<uint64_t>	head;	//step of the newest complete frame, +1 (0 = none yet)
+};
+
+//the ring is shared between processes, so the atomics must not fall
+//back to a lock inside this process
+#if __cplusplus>=201703L
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the published head must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the slot seq must be lock free");
+#else
+static_assert(ATOMIC_LLONG_LOCK_FREE==2 && ATOMIC_LONG_LOCK_FREE==2, "the published head must be lock free");
+static_assert(ATOMIC_INT_LOCK_FREE==2, "the slot seq must be lock free");
+#endif
+
+//a reader's copy of one slot
+struct publishedFrame
+{
+	uint64_t					step;
+	int							numBalls;
+	int							liveParticles;
+	std::vector<publishedBall>	balls;
+};
+
+inline size_t PublishedSlotBytes(int maxBalls) {return sizeof(publishedSlot) + maxBalls*sizeof(publishedBall);}
+inline size_t PublishedRingBytes(int maxBalls) {return sizeof(publishedRing) + PUBLISH_SLOTS*PublishedSlotBytes(maxBalls);}
+inline publishedSlot *PublishedSlot(publishedRing *r, uint64_t step) {return (publishedSlot *)((char *)(r+1) + (step % r->numSlots)*r->slotBytes);}
+inline publishedBall *PublishedBalls(publishedSlot *s) {return (publishedBall *)(s+1);}
+
+/*-----------------------------------------------------------
+  sharedMapping : a named shared memory region
+  -----------------------------------------------------------*/
+class sharedMapping
+{
+private:
+	void	*handle;
+	void	*base;
+	size_t	size;
+	bool	owner;
+	char	name[128];
+
+public:
+	sharedMapping():handle(0),base(0),size(0),owner(false){name[0] = 0;}
+	~sharedMapping(){Close();}
+
+	//fails if the name exists, unless replace is set
+	bool Create(const char *n, size_t bytes, bool replace);
+	bool Open(const char *n, size_t bytes);
+	void Close(void);
+	void *Base(void) const {return base;}
+};
+
+/*-----------------------------------------------------------
+  statePublisher class : the single writer
+  -----------------------------------------------------------*/
+class statePublisher
+{
+private:
+	sharedMapping	mapping;
+	publishedRing	*ring;
+	uint64_t		step;
+	bool			warned;
+
+public:
+	statePublisher():ring(0),step(0),warned(false){}
+
+	//frames are sized for maxBalls, normally the table's NumBalls().
+	//fails if another publisher has the name, unless replace is set
+	//(e.g. to clear the segment left by one that crashed)
+	bool Open(int maxBalls, const char *name = PUBLISH_NAME, bool replace = false);
+	void Close(void);
+	bool IsOpen(void) const {return ring!=0;}
+	//never blocks. a table with more than maxBalls balls is not
+	//published, and an error is logged the first time
+	void Publish(const table &t, int liveParticles);
+};
+
+/*-----------------------------------------------------------
+  stateReader class : any number of these, in any process
+  -----------------------------------------------------------*/
+class stateReader
+{
+private:
+	sharedMapping	mapping;
+	publishedRing	*ring;
+
+	bool ReadSlot(uint64_t step, publishedFrame &out) const;
+
+public:
+	stateReader():ring(0){}
+
+	bool Open(const char *name = PUBLISH_NAME);
+	void Close(void);
+	//the newest frame, false if nothing has been published or the
+	//writer has held the slot for PUBLISH_READ_TIMEOUT_MS
+	bool ReadLatest(publishedFrame &out) const;
+	//frames from step next onwards, up to max of them. next is moved
+	//past what was read; if the reader fell more than PUBLISH_SLOTS
+	//behind it skips ahead to the oldest frame still in the ring
+	int ReadSince(uint64_t &next, publishedFrame *out, int max) const;
+};
+
+//console mode : print frames as they are published
+int RunFollower(const char *name);
+
+#endif
@@ -0,0 +1,234 @@
+/*-----------------------------------------------------------
+  Render Queue Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"renderqueue.h"
+#include <string.h>
+#include <algorithm>
+#include<glut.h>
+
+//GL 1.2, past what Windows' gl.h declares
+#ifndef GL_RESCALE_NORMAL
+#define GL_RESCALE_NORMAL	0x803A
+#endif
+
+/*-----------------------------------------------------------
+  frameArena class members
+  -----------------------------------------------------------*/
+frameArena::frameArena(size_t bytes):size(bytes),used(0)
+{
+	base = new unsigned char[size];
+}
+
+frameArena::~frameArena()
+{
+	delete [] base;
+}
+
+size_t frameArena::Alloc(size_t bytes, size_t align)
+{
+	size_t offset = (used + align - 1) & ~(align - 1);
+	if(offset + bytes > size)
+	{
+		size_t grown = size*2;
+		while(offset + bytes > grown) grown *= 2;
+		unsigned char *bigger = new unsigned char[grown];
+		memcpy(bigger, base, used);
+		delete [] base;
+		base = bigger;
+		size = grown;
+	}
+	used = offset + bytes;
+	return offset;
+}
+
+/*-----------------------------------------------------------
+  renderQueue class members
+  -----------------------------------------------------------*/
+renderQueue::renderQueue(int slices, int stacks, bool s):
+	numItems(0),numVertices(0),sequence(0),sphereVertices(0),solid(s),drawCalls(0),stateChanges(0)
+{
+	//the unit sphere with its poles on z, as gluSphere; on a unit
+	//sphere the normal is the position, so one array serves both
+	std::vector<float> grid((stacks+1)*(slices+1)*3);
+	for(int i=0;i<=stacks;i++)
+	{
+		float rho = (float)(3.14159265358979*i/stacks);
+		for(int j=0;j<=slices;j++)
+		{
+			float theta = (float)(2.0*3.14159265358979*j/slices);
+			float *v = &grid[(i*(slices+1) + j)*3];
+			v[0] = sinf(rho)*cosf(theta);
+			v[1] = sinf(rho)*sinf(theta);
+			v[2] = cosf(rho);
+		}
+	}
+	#define GRID(i,j)	(&grid[((i)*(slices+1) + (j))*3])
+	if(solid)
+	{
+		spherePrimitive = GL_TRIANGLES;
+		for(int i=0;i<stacks;i++)
+			for(int j=0;j<slices;j++)
+			{
+				const float *quad[6] = {GRID(i,j), GRID(i+1,j), GRID(i+1,j+1), GRID(i,j), GRID(i+1,j+1), GRID(i,j+1)};
+				for(int k=0;k<6;k++) sphere.insert(sphere.end(), quad[k], quad[k]+3);
+			}
+	}
+	else
+	{
+		//the edges of the quads : rings between the poles, and meridians
+		spherePrimitive = GL_LINES;
+		for(int i=1;i<stacks;i++)
+			for(int j=0;j<slices;j++)
+			{
+				sphere.insert(sphere.end(), GRID(i,j), GRID(i,j)+3);
+				sphere.insert(sphere.end(), GRID(i,j+1), GRID(i,j+1)+3);
+			}
+		for(int j=0;j<slices;j++)
+			for(int i=0;i<stacks;i++)
+			{
+				sphere.insert(sphere.end(), GRID(i,j), GRID(i,j)+3);
+				sphere.insert(sphere.end(), GRID(i+1,j), GRID(i+1,j)+3);
+			}
+	}
+	#undef GRID
+	sphereVertices = (int)sphere.size()/3;
+}
+
+uint64_t renderQueue::Key(renderLayer layer, renderMesh mesh, uint32_t colour)
+{
+	//lines take their colour from the vertices, so it stays out of
+	//their key and they keep recording order within a layer
+	uint64_t key = ((uint64_t)layer << 60) | ((uint64_t)mesh << 56);
+	if(mesh!=MESH_LINES) key |= (uint64_t)(colour & 0xffffff) << 32;
+	return key | sequence++;
+}
+
+void renderQueue::Begin(void)
+{
+	items.Reset();
+	vertices.Reset();
+	numItems = 0;
+	numVertices = 0;
+	sequence = 0;
+}
+
+void renderQueue::Sphere(renderLayer layer, const vec4 &centre, float radius, uint32_t colour)
+{
+	renderItem *item = (renderItem *)items.At(items.Alloc(sizeof(renderItem), 8));
+	item->key = Key(layer, MESH_SPHERE, colour);
+	item->x = centre(0);
+	item->y = centre(1);
+	item->z = centre(2);
+	item->scale = radius;
+	item->first = item->count = 0;
+	numItems++;
+}
+
+void renderQueue::Line(renderLayer layer, const vec4 &a, const vec4 &b, uint32_t colour)
+{
+	renderVertex *v = (renderVertex *)vertices.At(vertices.Alloc(sizeof(renderVertex)*2));
+	v[0].x = a(0); v[0].y = a(1); v[0].z = a(2); v[0].colour = colour;
+	v[1].x = b(0); v[1].y = b(1); v[1].z = b(2); v[1].colour = colour;
+
+	renderItem *item = (renderItem *)items.At(items.Alloc(sizeof(renderItem), 8));
+	item->key = Key(layer, MESH_LINES, colour);
+	item->x = item->y = item->z = item->scale = 0.0f;
+	item->first = numVertices;
+	item->count = 2;
+	numVertices += 2;
+	numItems++;
+}
+
+static bool ItemBefore(const renderItem &a, const renderItem &b)
+{
+	return a.key < b.key;
+}
+
+void renderQueue::Submit(void)
+{
+	drawCalls = stateChanges = 0;
+	renderItem *item = (renderItem *)items.At(0);
+	std::sort(item, item + numItems, ItemBefore);
+
+	float view[16], model[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	int mesh = -1;
+	bool haveColour = false;
+	uint32_t colour = 0;
+	const unsigned char *lineBase = (const unsigned char *)vertices.At(0);
+	for(int i=0;i<numItems;)
+	{
+		const renderItem &it = item[i];
+		int itemMesh = (int)((it.key >> 56) & 0xf);
+		if(itemMesh!=mesh)
+		{
+			mesh = itemMesh;
+			stateChanges++;
+			if(mesh==MESH_SPHERE)
+			{
+				glDisableClientState(GL_COLOR_ARRAY);
+				glVertexPointer(3, GL_FLOAT, 0, &sphere[0]);
+				if(solid)
+				{
+					glEnableClientState(GL_NORMAL_ARRAY);
+					glNormalPointer(GL_FLOAT, 0, &sphere[0]);
+					//the unit sphere is scaled by the radius, which would
+					//shrink the normals and darken the lighting
+					glEnable(GL_RESCALE_NORMAL);
+				}
+			}
+			else
+			{
+				glLoadMatrixf(view);
+				glDisableClientState(GL_NORMAL_ARRAY);
+				if(solid) glDisable(GL_RESCALE_NORMAL);
+				glEnableClientState(GL_COLOR_ARRAY);
+				glVertexPointer(3, GL_FLOAT, sizeof(renderVertex), lineBase);
+				glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(renderVertex), lineBase + 3*sizeof(float));
+				haveColour = false;		//undefined after drawing with a colour array
+			}
+		}
+
+		if(mesh==MESH_SPHERE)
+		{
+			uint32_t c = (uint32_t)(it.key >> 32) & 0xffffff;
+			if(!haveColour || c!=colour)
+			{
+				colour = c;
+				haveColour = true;
+				glColor3ub((GLubyte)(c & 0xff), (GLubyte)((c >> 8) & 0xff), (GLubyte)((c >> 16) & 0xff));
+				stateChanges++;
+			}
+			//view * translate * scale
+			for(int k=0;k<12;k++) model[k] = view[k]*it.scale;
+			for(int k=0;k<4;k++) model[12+k] = view[k]*it.x + view[4+k]*it.y + view[8+k]*it.z + view[12+k];
+			glLoadMatrixf(model);
+			glDrawArrays(spherePrimitive, 0, sphereVertices);
+			drawCalls++;
+			i++;
+			continue;
+		}
+
+		//runs of lines with consecutive vertices go in one draw
+		int first = it.first, count = it.count;
+		uint64_t layer = it.key >> 60;
+		for(i++;i<numItems;i++)
+		{
+			const renderItem &next = item[i];
+			if((next.key >> 56) != ((layer << 4) | MESH_LINES) || next.first!=first+count) break;
+			count += next.count;
+		}
+		glDrawArrays(GL_LINES, first, count);
+		drawCalls++;
+	}
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	if(solid) glDisable(GL_RESCALE_NORMAL);
+	glLoadMatrixf(view);
+	glColor3f(1.0f,1.0f,1.0f);
+}
@@ -0,0 +1,128 @@
+/*-----------------------------------------------------------
+  Render Queue Header File
+  The scene is recorded as draw items instead of drawn in
+  immediate mode : each item is a mesh, a transform, a colour
+  and a layer, kept in memory that is reset every frame. At
+  the end of the frame the items are sorted by a key built
+  from that state and submitted with vertex arrays, so state
+  is set once per run of equal items rather than per object.
+  Spheres share one mesh and cost a matrix load and a draw
+  each; every line in the frame goes in one draw, with the
+  colour per vertex.
+  -----------------------------------------------------------*/
+#ifndef renderqueue_h_included
+#define renderqueue_h_included
+
+#include"vecmath.h"
+#include <stdint.h>
+#include <vector>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define RENDER_ARENA_BYTES	(64*1024)	//starting size, grows to the busiest frame
+#define RENDER_RGB(r,g,b)	((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | 0xff000000u)
+
+enum renderLayer
+{
+	LAYER_SCENE,
+	LAYER_OVERLAY,		//after the scene : aim lines
+};
+
+enum renderMesh
+{
+	MESH_SPHERE,
+	MESH_LINES,
+};
+
+/*-----------------------------------------------------------
+  frameArena : a linear allocator reset every frame
+  Allocations are handed out as offsets, so the buffer can
+  grow (it doubles) without invalidating earlier ones. Once
+  it has reached the busiest frame's size nothing more is
+  allocated.
+  -----------------------------------------------------------*/
+class frameArena
+{
+private:
+	unsigned char	*base;
+	size_t			size;
+	size_t			used;
+
+	frameArena(const frameArena &);
+	frameArena &operator =(const frameArena &);
+
+public:
+	frameArena(size_t bytes = RENDER_ARENA_BYTES);
+	~frameArena();
+
+	//offset of bytes more; allocations of a size that is a multiple of
+	//align follow each other, so they can be walked as an array
+	size_t Alloc(size_t bytes, size_t align = 16);
+	void Reset(void) {used = 0;}
+	void *At(size_t offset) const {return base + offset;}
+	size_t Used(void) const {return used;}
+	size_t Size(void) const {return size;}
+};
+
+/*-----------------------------------------------------------
+  draw items
+  -----------------------------------------------------------*/
+struct renderItem
+{
+	uint64_t	key;		//layer, mesh, colour, then recording order
+	float		x, y, z;	//sphere centre
+	float		scale;		//sphere radius
+	int			first;		//lines : vertex range
+	int			count;
+};
+
+struct renderVertex
+{
+	float		x, y, z;
+	uint32_t	colour;		//RENDER_RGB
+};
+
+/*-----------------------------------------------------------
+  renderQueue class
+  Record between Begin and Submit, with the view already on
+  the modelview matrix. Submit leaves the modelview matrix
+  as it found it.
+  -----------------------------------------------------------*/
+class renderQueue
+{
+private:
+	frameArena		items;			//renderItem array
+	frameArena		vertices;		//renderVertex array, all the lines
+	int				numItems;
+	int				numVertices;
+	uint32_t		sequence;
+
+	//unit sphere, built once
+	std::vector<float>	sphere;
+	int				sphereVertices;
+	unsigned int	spherePrimitive;
+	bool			solid;
+
+	//last Submit
+	int				drawCalls;
+	int				stateChanges;
+
+	uint64_t Key(renderLayer layer, renderMesh mesh, uint32_t colour);
+
+public:
+	//slices and stacks as gluSphere; solid spheres have normals for
+	//lighting, wire ones are the quads' edges
+	renderQueue(int slices, int stacks, bool solid);
+
+	void Begin(void);
+	void Sphere(renderLayer layer, const vec4 &centre, float radius, uint32_t colour);
+	void Line(renderLayer layer, const vec4 &a, const vec4 &b, uint32_t colour);
+	void Submit(void);
+
+	int Items(void) const {return numItems;}
+	int DrawCalls(void) const {return drawCalls;}
+	int StateChanges(void) const {return stateChanges;}
+};
+
+#endif
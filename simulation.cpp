@@ -3,13 +3,12 @@
   -----------------------------------------------------------*/
 #include"stdafx.h"
 #include"simulation.h"
-#include <iostream>
+#include"metrics.h"
+#include <string.h>
+#include <float.h>
+#include <chrono>
+#include <algorithm>
 using namespace std;
-/*-----------------------------------------------------------
-  macros
-  -----------------------------------------------------------*/
-#define SMALL_VELOCITY		(0.01f)
-
 /*-----------------------------------------------------------
   globals
   -----------------------------------------------------------*/
@@ -29,34 +28,6 @@ float gGravityAccn = 9.8f;
 /*-----------------------------------------------------------
   ball class members
   -----------------------------------------------------------*/
-int ball::ballIndexCnt = 0;
-
-void ball::Reset(void)
-{
-	//set velocity to zero
-	velocity = 0.0;
-
-	//work out rack position
-	if(index==0)
-	{
-		position(1) = 0.5;
-		position(0) = 0.0;
-		return;
-	}
-	
-	static const float sep = (BALL_RADIUS*3.0f);
-	static const float rowSep = (BALL_RADIUS*2.5f);
-	int row = 1;
-	int rowIndex = index;
-	while(rowIndex > row)
-	{
-		rowIndex -= row;
-		row++;
-	}
-	position(1) =  -(rowSep * (row-1));
-	position(0) = (((row-1)*sep)/2.0f) - (sep*(row-rowIndex));
-}
-
 void ball::ApplyImpulse(vec2 imp)
 {
 	velocity = imp;
@@ -64,39 +35,71 @@ void ball::ApplyImpulse(vec2 imp)
 
 void ball::ApplyFrictionForce(int ms)
 {
-	if(velocity.Magnitude()<=0.0) return;
+	double speed = velocity.Magnitude();
+	if(speed<=0.0) return;
 
 	//accelaration is opposite to direction of motion
-	vec2 accelaration = -velocity.Normalised();
 	//friction force = constant * mg
 	//F=Ma, so accelaration = force/mass = constant*g
-	accelaration *= (gCoeffFriction * gGravityAccn);
-	//integrate velocity : find change in velocity
-	vec2 velocityChange = ((accelaration * ms)/1000.0f);
+	//integrate velocity : find change in speed
+	double speedChange = ((gCoeffFriction * gGravityAccn) * ms)/1000.0f;
 	//cap magnitude of change in velocity to remove integration errors
-	if(velocityChange.Magnitude() > velocity.Magnitude()) velocity = 0.0;
-	else velocity += velocityChange;
+	if(speedChange > speed) velocity = 0.0;
+	else velocity *= ((speed - speedChange)/speed);
 }
 
-void ball::DoPlaneCollisions(cushion* c)
+int ball::DoPlaneCollisions(cushion* c, collisionEvent *out)
 {
 	//test each plane for collision
+	int n = 0;
 	for(int i=0;i<NUM_CUSHION;i++){
 		if(HasHitPlane(*(c+i))){ 
-			HitPlane(*(c+i));
-			particleSetMgr* psm = particleSetMgr::Instance();
-			psm->Firework(this->CollisionPos(*(c+i)));
+			collisionEvent &e = out[n++];
+			e.type = COLLISION_CUSHION;
+			e.a = index;
+			e.b = i;
+			e.position = CollisionPos(*(c+i));
+			e.impulse = HitPlane(*(c+i));
 		}
 	}
+	return n;
 }
 
-void ball::DoBallCollision(ball &b)
+//closed form version of DoPlaneCollisions for a table whose cushions
+//are the four sides of bounds. Tests run in the same order as the
+//generic cushions (+z, -x, -z, +x) and give the same results
+static void RectEvent(collisionEvent &e, int a, int cushion, double x, double z, float impulse)
 {
-	if(HasHitBall(b)){
-		HitBall(b);
-		particleSetMgr* psm = particleSetMgr::Instance();
-		psm->Firework(this->CollisionPos(b));
-	}
+	e.type = COLLISION_CUSHION;
+	e.a = a;
+	e.b = cushion;
+	e.position = vec2(x, z);
+	e.impulse = impulse;
+}
+
+int ball::DoRectPlaneCollisions(const rectBounds &bounds, collisionEvent *out)
+{
+	int n = 0;
+	if(velocity(1) > 0.0 && (bounds.maxZ-position(1)) <= radius)
+		RectEvent(out[n++], index, 0, position(0), bounds.maxZ, HitRectPlane(1));
+	if(velocity(0) < 0.0 && (position(0)-bounds.minX) <= radius)
+		RectEvent(out[n++], index, 1, bounds.minX, position(1), HitRectPlane(0));
+	if(velocity(1) < 0.0 && (position(1)-bounds.minZ) <= radius)
+		RectEvent(out[n++], index, 2, position(0), bounds.minZ, HitRectPlane(1));
+	if(velocity(0) > 0.0 && (bounds.maxX-position(0)) <= radius)
+		RectEvent(out[n++], index, 3, bounds.maxX, position(1), HitRectPlane(0));
+	return n;
+}
+
+bool ball::DoBallCollision(ball &b, collisionEvent *out)
+{
+	if(!HasHitBall(b)) return false;
+	out->type = COLLISION_BALL;
+	out->a = index;
+	out->b = b.index;
+	out->position = CollisionPos(b);
+	out->impulse = HitBall(b);
+	return true;
 }
 
 void ball::Update(int ms)
@@ -106,7 +109,21 @@ void ball::Update(int ms)
 	//integrate position
 	position += ((velocity * ms)/1000.0f);
 	//set small velocities to zero
-	if(velocity.Magnitude()<SMALL_VELOCITY) velocity = 0.0;
+	if(velocity.Magnitude2()<(SMALL_VELOCITY*SMALL_VELOCITY)) velocity = 0.0;
+}
+
+//Update for a step of any length, the fast balls' sub-steps
+void ball::Advance(double seconds)
+{
+	double speed = velocity.Magnitude();
+	if(speed>0.0)
+	{
+		double speedChange = gCoeffFriction*gGravityAccn*seconds;
+		if(speedChange > speed) velocity = 0.0;
+		else velocity *= ((speed - speedChange)/speed);
+	}
+	position += velocity*seconds;
+	if(velocity.Magnitude2()<(SMALL_VELOCITY*SMALL_VELOCITY)) velocity = 0.0;
 }
 
 bool ball::HasHitPlane(cushion &c) const
@@ -121,22 +138,21 @@ bool ball::HasHitPlane(cushion &c) const
 
 bool ball::HasHitBall(const ball &b) const
 {
-	//work out relative position of ball from other ball,
-	//distance between balls
+	//work out relative position of ball from other ball
 	//and relative velocity
 	vec2 relPosn = position - b.position;
-	float dist = (float) relPosn.Magnitude();
-	vec2 relPosnNorm = relPosn.Normalised();
 	vec2 relVelocity = velocity - b.velocity;
 
 	//if moving apart, cannot have hit
-	if(relVelocity.Dot(relPosnNorm) >= 0.0) return false;
-	//if distnce is more than sum of radii, have not hit
-	if(dist > (radius+b.radius)) return false;
+	if(relVelocity.Dot(relPosn) >= 0.0) return false;
+	//if distance is more than sum of radii, have not hit
+	//(compare squares, no need for the square root)
+	double sumRadii = radius+b.radius;
+	if(relPosn.Magnitude2() > (sumRadii*sumRadii)) return false;
 	return true;
 }
 
-void ball::HitPlane(cushion &c)
+float ball::HitPlane(cushion &c)
 {
 	//assume elastic collision
 	//find plane normal
@@ -149,10 +165,19 @@ void ball::HitPlane(cushion &c)
 	//reverse perpendicular component
 	//parallel component is unchanged
 	velocity = parallel + (-perp)*gCoeffRestitution;
+	return (float)(perp.Magnitude()*(1.0+gCoeffRestitution)*mass);
 }
 
+float ball::HitRectPlane(int axis)
+{
+	//the normal is along one axis : reverse that component,
+	//the other one is parallel to the cushion and unchanged
+	double perp = velocity(axis);
+	velocity(axis) = -perp*gCoeffRestitution;
+	return (float)(fabs(perp)*(1.0+gCoeffRestitution)*mass);
+}
 
-void ball::HitBall(ball &b)
+float ball::HitBall(ball &b)
 {
 	//find direction from other ball to this ball
 	vec2 relDir = (position - b.position).Normalised();
@@ -175,6 +200,7 @@ void ball::HitBall(ball &b)
 	//find new velocities by adding unchanged parallel component to new perpendicluar component
 	velocity = parallelV + (relDir*perpVNew);
 	b.velocity = parallelV2 + (relDir*perpVNew2);
+	return (float)fabs((perpVNew-perpV)*mass);
 }
 
 vec2 ball::CollisionPos(const ball &b) const
@@ -190,8 +216,8 @@ vec2 ball::CollisionPos(const cushion &c) const
 	vec2 ball_to_end = c.end - position;
 	//the rate of projected point to cushion's end over cushion'start to end
 	//LET k = |P2-P0|/|P2-P1|
-	//k = (P2-P3)*(P2-P1)/|P2-P1|
-	double k = ball_to_end.Dot(plane.Normalised())/plane.Magnitude();
+	//k = (P2-P3)*(P2-P1)/|P2-P1|^2
+	double k = ball_to_end.Dot(plane)/plane.Magnitude2();
 	//P0 = P2 - (P2-P1)*k
 	return c.end - plane*k;
 	
@@ -203,33 +229,531 @@ vec2 ball::CollisionPos(const cushion &c) const
 /*-----------------------------------------------------------
   table class members
   -----------------------------------------------------------*/
+static uint64_t Mix64(uint64_t x)
+{
+	//splitmix64 finaliser
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+//smallest rack row r holding object ball k, rows 1..r hold r(r+1)/2 balls
+static int RackRow(int k)
+{
+	int row = (int)ceil((sqrt(8.0*k + 1.0) - 1.0)/2.0);
+	while((row*(row+1))/2 < k) row++;
+	while(row>1 && ((row-1)*row)/2 >= k) row--;
+	return row;
+}
+
+table::table(int numBalls, tableLayout l, unsigned int s):
+	rectangular(false),layout(l),seed(s),activeList(numBalls),activeCount(0),
+	isActive(numBalls, 0),isFast(numBalls, 0),fastList(numBalls),numFast(0),version(0),steps(0),numEvents(0),ballHash(numBalls, 0),
+	maxRadius(BALL_RADIUS),balls(numBalls)
+{
+	scale = FitScale(numBalls);
+	double x = TABLE_X*scale;
+	double z = TABLE_Z*scale;
+	cushions[0].SetPosition(x, z, -x, z);
+	cushions[1].SetPosition(-x, z, -x, -z);
+	cushions[2].SetPosition(-x, -z, x, -z);
+	cushions[3].SetPosition(x, -z, x, z);
+	bounds.minX = -x;
+	bounds.maxX = x;
+	bounds.minZ = -z;
+	bounds.maxZ = z;
+	DetectRectangular();
+
+	//the grid covers the cloth with a cell to spare each side, balls
+	//outside it are filed in the edge cells
+	useGrid = (numBalls>=BROADPHASE_MIN_BALLS);
+	gridMinX = -x - BROADPHASE_CELL;
+	gridMinZ = -z - BROADPHASE_CELL;
+	gridInvCell = 1.0/BROADPHASE_CELL;
+	gridCols = (int)ceil((2.0*x)/BROADPHASE_CELL) + 2;
+	gridRows = (int)ceil((2.0*z)/BROADPHASE_CELL) + 2;
+	if(useGrid)
+	{
+		cellFirst.assign(gridCols*gridRows, -1);
+		ballCell.assign(numBalls, -1);
+		ballNext.assign(numBalls, -1);
+		ballPrev.assign(numBalls, -1);
+		candidates.resize(numBalls);
+	}
+	narrow.Reserve(numBalls*BROADPHASE_PAIRS);
+	hits.resize(numBalls*BROADPHASE_PAIRS);
+	//a step where every ball hits a cushion and its share of pairs
+	events.resize(numBalls*(NUM_CUSHION + BROADPHASE_PAIRS));
+
+	//scatter : ball i gets grid cell (i*stride) mod cells, with the
+	//stride coprime to the number of cells so no cell is used twice
+	double margin = BALL_RADIUS*2.0;
+	scatterCols = (int64_t)floor((2.0*x - margin)/SCATTER_CELL);
+	scatterRows = (int64_t)floor((2.0*z - margin)/SCATTER_CELL);
+	int64_t cells = scatterCols*scatterRows;
+	for(scatterStride=(cells*5)/8+1;;scatterStride++)
+	{
+		int64_t a = scatterStride, b = cells;
+		while(b) {int64_t t = a%b; a = b; b = t;}
+		if(a==1) break;
+	}
+
+	for(int i=0;i<numBalls;i++) balls[i].index = i;
+	Reset();
+}
+
+//the smallest scale, at least 1, at which the layout is inside the cushions
+double table::FitScale(int numBalls) const
+{
+	double margin = BALL_RADIUS*2.0;
+	if(layout==LAYOUT_RACK)
+	{
+		int rows = (numBalls>1) ? RackRow(numBalls-1) : 1;
+		double needX = ((rows-1)*RACK_SEPARATION)/2.0 + margin;
+		double needZ = ((rows-1)*RACK_ROW_SEPARATION) + margin;
+		double s = 1.0;
+		if(needX > TABLE_X*s) s = needX/TABLE_X;
+		if(needZ > TABLE_Z*s) s = needZ/TABLE_Z;
+		return s;
+	}
+	//scatter : enough whole grid cells for every ball
+	double s = sqrt((numBalls*SCATTER_CELL*SCATTER_CELL)/(4.0*TABLE_X*TABLE_Z));
+	if(s<1.0) s = 1.0;
+	for(;;)
+	{
+		double cols = floor((2.0*TABLE_X*s - margin)/SCATTER_CELL);
+		double rows = floor((2.0*TABLE_Z*s - margin)/SCATTER_CELL);
+		if(cols*rows >= numBalls) return s;
+		s *= 1.01;
+	}
+}
+
+//closed form position of ball i in the table's layout
+vec2 table::LayoutPosition(int i) const
+{
+	if(layout==LAYOUT_RACK)
+	{
+		if(i==0) return vec2(0.0, 0.5*scale);
+		static const float sep = RACK_SEPARATION;
+		static const float rowSep = RACK_ROW_SEPARATION;
+		int row = RackRow(i);
+		int rowIndex = i - ((row-1)*row)/2;
+		return vec2((((row-1)*sep)/2.0f) - (sep*(row-rowIndex)), -(rowSep * (row-1)));
+	}
+
+	//scatter : the ball's grid cell, and a random offset in it that
+	//keeps it clear of the neighbouring cells' balls
+	int64_t cols = scatterCols;
+	int64_t rows = scatterRows;
+	int64_t cell = (i*scatterStride)%(cols*rows);
+	uint64_t r = Mix64(((uint64_t)seed<<32) ^ (uint64_t)i ^ 0x5851f42d4c957f2dULL);
+	double jitter = SCATTER_CELL - 2.0*BALL_RADIUS;
+	double jx = ((r & 0xffffffffULL)/4294967296.0 - 0.5)*jitter;
+	double jz = ((r >> 32)/4294967296.0 - 0.5)*jitter;
+	return vec2((cell%cols - (cols-1)/2.0)*SCATTER_CELL + jx, (cell/cols - (rows-1)/2.0)*SCATTER_CELL + jz);
+}
+
 void table::Update(int ms)
 {
-	//check for collisions with planes, for all balls
-	for(int i=0;i<NUM_BALLS;i++) balls[i].DoPlaneCollisions(cushions);
-	
-	//check for collisions between pairs of balls
-	for(int i=0;i<NUM_BALLS;i++) 
+	//only balls in the active set are moving, sleeping ones are skipped
+	//entirely until something hits them
+	numEvents = 0;
+	if(activeCount==0) return;
+	version++;
+	steps++;
+	//reading the clock costs as much as a small step, so only a
+	//sample of the steps is timed
+	bool timed = (steps%METRICS_LATENCY_SAMPLE)==0;
+	std::chrono::steady_clock::time_point start;
+	if(timed) start = std::chrono::steady_clock::now();
+
+	//balls that would travel more than CCD_MAX_TRAVEL this step are
+	//moved in sub-steps of their own first, so they cannot pass
+	//through a ball or a cushion; the rest take the one plain step.
+	//Sub-steps are fractions of a millisecond when they need to be,
+	//so no ball moves further than CCD_MAX_TRAVEL in one at any speed
+	int subSteps = 1;
+	int pairTests = 0;
+	numFast = 0;
+	for(int k=0;k<activeCount;k++)
 	{
-		for(int j=(i+1);j<NUM_BALLS;j++) 
+		int i = activeList[k];
+		double travel = balls[i].velocity.Magnitude()*ms/1000.0;
+		if(travel<=CCD_MAX_TRAVEL) continue;
+		int n = (int)ceil(travel/CCD_MAX_TRAVEL);
+		if(n>subSteps) subSteps = n;
+		isFast[i] = 1;
+		fastList[numFast++] = i;
+	}
+	double seconds = ms/1000.0;
+	double h = seconds/subSteps;
+	for(int s=0;s<subSteps && numFast>0;s++)
+	{
+		//a ball a hit makes fast joins the fast list now : it moves
+		//in this sub-step and is tested from the next one
+		PlaneCollisions(true);
+		pairTests += BallCollisions(true, h, seconds);
+		for(int k=0;k<numFast;k++)
 		{
-			balls[i].DoBallCollision(balls[j]);
+			balls[fastList[k]].Advance(h);
+			Refile(fastList[k]);
 		}
 	}
+
+	//the slow balls, including any a fast ball woke
+	PlaneCollisions(false);
+	pairTests += BallCollisions(false, seconds, seconds);
+	//the hits are counted from the events DoBallCollision and the
+	//cushion tests wrote, so the metrics cost one call a step
+	int ballHits = 0;
+	for(int e=0;e<numEvents;e++)
+	{
+		events[e].step = steps;
+		if(events[e].type==COLLISION_BALL) ballHits++;
+	}
 	
-	//update all balls
-	for(int i=0;i<NUM_BALLS;i++) balls[i].Update(ms);
+	//update the moving balls, and put the ones that stopped to sleep
+	for(int k=activeCount-1;k>=0;k--)
+	{
+		int i = activeList[k];
+		ball &b = balls[i];
+		if(isFast[i]) isFast[i] = 0;
+		else b.Update(ms);
+		if(b.velocity(0)==0.0 && b.velocity(1)==0.0) Sleep(k);
+		Rehash(i);
+		Refile(i);
+	}
+	MetricTableStep(pairTests, ballHits, numEvents - ballHits);
+	if(timed) MetricStepLatency((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+//cushion hits for the fast list, or for the active balls that are
+//not on it
+void table::PlaneCollisions(bool fast)
+{
+	const int *list = fast ? &fastList[0] : &activeList[0];
+	int count = fast ? numFast : activeCount;
+	ReserveEvents(count*NUM_CUSHION);
+	for(int k=0;k<count;k++)
+	{
+		ball &b = balls[list[k]];
+		if(!fast && isFast[list[k]]) continue;
+		if(rectangular) numEvents += b.DoRectPlaneCollisions(bounds, &events[numEvents]);
+		else numEvents += b.DoPlaneCollisions(cushions, &events[numEvents]);
+	}
+}
+
+//check for collisions between pairs of balls : pairs of sleeping balls
+//are never candidates, and a sleeping ball only becomes one when it is
+//within reach of a moving ball's travel over seconds, which is a
+//sub-step of a step of stepSeconds for the fast list. On a big table
+//the candidates for each moving ball come from the broadphase grid,
+//sorted into the index order a scan of every ball finds them in.
+//The narrowphase filters them in batches and the hits are resolved
+//in pair order.
+//For the fast list, a ball a hit sets moving fast joins it for the
+//rest of the sub-steps; the pairs are all chosen before any hit, so
+//they come from the list as it was. Returns the pairs tested
+int table::BallCollisions(bool fast, double seconds, double stepSeconds)
+{
+	const int *list = fast ? &fastList[0] : &activeList[0];
+	int count = fast ? numFast : activeCount;
+	//how far the other fast balls can reach into a pair
+	double otherSweep = 0.0;
+	for(int k=0;k<count && fast && useGrid;k++)
+	{
+		double sweep = balls[list[k]].velocity.Magnitude()*seconds;
+		if(sweep>otherSweep) otherSweep = sweep;
+	}
+	narrow.Clear();
+	for(int k=0;k<count;k++) 
+	{
+		int i = list[k];
+		if(!fast && isFast[i]) continue;
+		double sweep = balls[i].velocity.Magnitude()*seconds;
+		int numCandidates = useGrid ? Candidates(i, balls[i].radius + maxRadius + sweep + otherSweep) : NumBalls();
+		for(int c=0;c<numCandidates;c++) 
+		{
+			int j = useGrid ? candidates[c] : c;
+			if(j==i) continue;
+			if(fast)
+			{
+				//fast pairs are added once, from their lower index,
+				//and reach covers both balls' travel
+				if(isFast[j] && j<i) continue;
+				double reach = balls[i].radius + balls[j].radius + sweep;
+				if(isFast[j]) reach += balls[j].velocity.Magnitude()*seconds;
+				if((balls[i].position - balls[j].position).Magnitude2() > (reach*reach)) continue;
+			}
+			else if(isFast[j])
+			{
+				//tested in the sub-steps
+				continue;
+			}
+			else if(isActive[j])
+			{
+				//active pairs are added once, from their lower index
+				if(j<i) continue;
+			}
+			else
+			{
+				double reach = balls[i].radius + balls[j].radius + sweep;
+				if((balls[i].position - balls[j].position).Magnitude2() > (reach*reach)) continue;
+			}
+			const ball &a = balls[i];
+			const ball &b = balls[j];
+			narrow.Add(i, j, a.position(0)-b.position(0), a.position(1)-b.position(1),
+				a.velocity(0)-b.velocity(0), a.velocity(1)-b.velocity(1), a.radius+b.radius);
+		}
+	}
+	int numPairs = narrow.Count();
+	if(numPairs > (int)hits.size()) hits.resize(numPairs);
+	int numHits = numPairs ? narrow.Test(&hits[0]) : 0;
+	ReserveEvents(numHits);
+	for(int i=0;i<numHits;i++)
+	{
+		int a = hits[i].a;
+		int b = hits[i].b;
+		if(!balls[a].DoBallCollision(balls[b], &events[numEvents])) continue;
+		numEvents++;
+		Wake(b);
+		if(fast && !isFast[b] && balls[b].velocity.Magnitude()*stepSeconds > CCD_MAX_TRAVEL)
+		{
+			isFast[b] = 1;
+			fastList[numFast++] = b;
+		}
+	}
+	return numPairs;
+}
+
+void table::Wake(int i)
+{
+	if(isActive[i]) return;
+	isActive[i] = true;
+	activeList[activeCount++] = i;
+}
+
+size_t table::Footprint(void) const
+{
+	return sizeof(table) + balls.capacity()*sizeof(ball) + narrow.HeapBytes() +
+		hits.capacity()*sizeof(ballPair) + events.capacity()*sizeof(collisionEvent) +
+		(activeList.capacity() + fastList.capacity() + candidates.capacity())*sizeof(int) +
+		(isActive.capacity() + isFast.capacity())*sizeof(char) + ballHash.capacity()*sizeof(uint64_t) +
+		(cellFirst.capacity() + ballCell.capacity() + ballNext.capacity() + ballPrev.capacity())*sizeof(int);
+}
+
+//room for count more events this step. The buffer only grows, so once
+//a table has seen its busiest step the solver allocates nothing
+void table::ReserveEvents(int count)
+{
+	if(numEvents+count > (int)events.size()) events.resize((numEvents+count)*2);
+}
+
+void table::Sleep(int slot)
+{
+	//swap the last active ball into the empty slot
+	isActive[activeList[slot]] = false;
+	activeList[slot] = activeList[--activeCount];
+}
+
+//move ball i to the grid cell its centre is now in
+void table::Refile(int i)
+{
+	if(!useGrid) return;
+	int cx = (int)floor((balls[i].position(0) - gridMinX)*gridInvCell);
+	int cz = (int)floor((balls[i].position(1) - gridMinZ)*gridInvCell);
+	cx = (cx<0) ? 0 : ((cx>=gridCols) ? gridCols-1 : cx);
+	cz = (cz<0) ? 0 : ((cz>=gridRows) ? gridRows-1 : cz);
+	int cell = cz*gridCols + cx;
+	if(cell==ballCell[i]) return;
+	//unlink
+	if(ballCell[i]>=0)
+	{
+		if(ballPrev[i]>=0) ballNext[ballPrev[i]] = ballNext[i];
+		else cellFirst[ballCell[i]] = ballNext[i];
+		if(ballNext[i]>=0) ballPrev[ballNext[i]] = ballPrev[i];
+	}
+	//and put at the head of the new cell
+	ballCell[i] = cell;
+	ballPrev[i] = -1;
+	ballNext[i] = cellFirst[cell];
+	if(ballNext[i]>=0) ballPrev[ballNext[i]] = i;
+	cellFirst[cell] = i;
+}
+
+void table::RefileAll(void)
+{
+	maxRadius = 0.0f;
+	for(int i=0;i<NumBalls();i++)
+	{
+		if(balls[i].radius>maxRadius) maxRadius = balls[i].radius;
+		Refile(i);
+	}
+}
+
+//the balls other than i whose centres may be within range of i's,
+//into candidates in index order; returns how many
+int table::Candidates(int i, double range)
+{
+	const vec2 &p = balls[i].position;
+	int x0 = (int)floor((p(0) - range - gridMinX)*gridInvCell);
+	int x1 = (int)floor((p(0) + range - gridMinX)*gridInvCell);
+	int z0 = (int)floor((p(1) - range - gridMinZ)*gridInvCell);
+	int z1 = (int)floor((p(1) + range - gridMinZ)*gridInvCell);
+	if(x0<0) x0 = 0;
+	if(z0<0) z0 = 0;
+	if(x1>=gridCols) x1 = gridCols-1;
+	if(z1>=gridRows) z1 = gridRows-1;
+	int n = 0;
+	for(int z=z0;z<=z1;z++)
+	{
+		for(int x=x0;x<=x1;x++)
+		{
+			for(int j=cellFirst[z*gridCols+x];j>=0;j=ballNext[j])
+			{
+				if(j!=i) candidates[n++] = j;
+			}
+		}
+	}
+	std::sort(candidates.begin(), candidates.begin()+n);
+	return n;
+}
+
+void table::ApplyImpulse(int i, vec2 imp)
+{
+	balls[i].ApplyImpulse(imp);
+	version++;
+	if(balls[i].velocity(0)!=0.0 || balls[i].velocity(1)!=0.0) Wake(i);
+	Rehash(i);
+}
+
+void table::SetBall(int i, vec2 pos, vec2 vel)
+{
+	balls[i].position = pos;
+	balls[i].velocity = vel;
+	version++;
+	if(vel(0)!=0.0 || vel(1)!=0.0) Wake(i);
+	else if(isActive[i])
+	{
+		for(int k=0;k<activeCount;k++) if(activeList[k]==i) {Sleep(k); break;}
+	}
+	Rehash(i);
+	Refile(i);
+}
+
+void table::Reset(void)
+{
+	for(int i=0;i<NumBalls();i++)
+	{
+		balls[i].position = LayoutPosition(i);
+		balls[i].velocity = 0.0;
+		isActive[i] = false;
+	}
+	activeCount = 0;
+	version++;
+	RehashAll();
+}
+
+//each ball contributes the xor of its quantised position, velocity
+//and active flag, each mixed with a fixed random key. Re-hashing a
+//ball xors out its old share and xors in the new one, so a step only
+//costs work for the balls that moved. Keys are generated from the
+//ball index, so there is no key table to size
+static uint64_t ZobristKey(int i, int c)
+{
+	return Mix64(((uint64_t)i*5 + c + 2)*0x9e3779b97f4a7c15ULL);
+}
+
+static uint64_t Quantise(double x, double step)
+{
+	return (uint64_t)(int64_t)floor((x/step) + 0.5);
+}
+
+void table::Rehash(int i)
+{
+	const ball &b = balls[i];
+	uint64_t h = Mix64(ZobristKey(i,0) ^ Quantise(b.position(0), HASH_POSITION_STEP));
+	h ^= Mix64(ZobristKey(i,1) ^ Quantise(b.position(1), HASH_POSITION_STEP));
+	h ^= Mix64(ZobristKey(i,2) ^ Quantise(b.velocity(0), HASH_VELOCITY_STEP));
+	h ^= Mix64(ZobristKey(i,3) ^ Quantise(b.velocity(1), HASH_VELOCITY_STEP));
+	if(isActive[i]) h ^= ZobristKey(i,4);
+	hash ^= ballHash[i] ^ h;
+	ballHash[i] = h;
+}
+
+void table::RehashAll(void)
+{
+	hash = 0;
+	for(int i=0;i<NumBalls();i++)
+	{
+		ballHash[i] = 0;
+		Rehash(i);
+	}
+	RefileAll();
+}
+
+void table::DetectRectangular(void)
+{
+	//the cushions have to be exactly the ones the constructor builds
+	rectangular = 
+		cushions[0].start == vec2(bounds.maxX, bounds.maxZ) && cushions[0].end == vec2(bounds.minX, bounds.maxZ) &&
+		cushions[1].start == vec2(bounds.minX, bounds.maxZ) && cushions[1].end == vec2(bounds.minX, bounds.minZ) &&
+		cushions[2].start == vec2(bounds.minX, bounds.minZ) && cushions[2].end == vec2(bounds.maxX, bounds.minZ) &&
+		cushions[3].start == vec2(bounds.maxX, bounds.minZ) && cushions[3].end == vec2(bounds.maxX, bounds.maxZ);
 }
 
 bool table::AnyBallsMoving(void) const
 {
-	//return true if any ball has a non-zero velocity
-	for(int i=0;i<NUM_BALLS;i++) 
+	//every ball with a non-zero velocity is in the active set
+	return (activeCount > 0);
+}
+
+
+void table::SaveHeader(snapshotHeader &h, int *active) const
+{
+	h.version = version;
+	h.hash = hash;
+	h.activeCount = activeCount;
+	if(activeCount) memcpy(active, &activeList[0], sizeof(int)*activeCount);
+}
+
+void table::SaveBalls(int first, int count, ballState *out) const
+{
+	for(int i=0;i<count;i++)
 	{
-		if(balls[i].velocity(0)!=0.0) return true;
-		if(balls[i].velocity(1)!=0.0) return true;
+		const ball &b = balls[first+i];
+		out[i].position[0] = b.position(0);
+		out[i].position[1] = b.position(1);
+		out[i].velocity[0] = b.velocity(0);
+		out[i].velocity[1] = b.velocity(1);
+		out[i].hash = ballHash[first+i];
+	}
+}
+
+void table::RestoreHeader(const snapshotHeader &h, const int *active)
+{
+	version = h.version;
+	hash = h.hash;
+	for(int i=0;i<activeCount;i++) isActive[activeList[i]] = false;
+	activeCount = h.activeCount;
+	if(activeCount) memcpy(&activeList[0], active, sizeof(int)*activeCount);
+	for(int i=0;i<activeCount;i++) isActive[activeList[i]] = true;
+}
+
+void table::RestoreBalls(int first, int count, const ballState *in)
+{
+	for(int i=0;i<count;i++)
+	{
+		ball &b = balls[first+i];
+		bool moved = b.position(0)!=in[i].position[0] || b.position(1)!=in[i].position[1];
+		b.position(0) = in[i].position[0];
+		b.position(1) = in[i].position[1];
+		b.velocity(0) = in[i].velocity[0];
+		b.velocity(1) = in[i].velocity[1];
+		ballHash[first+i] = in[i].hash;
+		if(moved) Refile(first+i);
 	}
-	return false;
 }
 
 
@@ -256,39 +780,58 @@ void cushion::SetPosition(double start_x, double start_y, double end_x, double e
   -----------------------------------------------------------*/
 
 void particle::Reset(const vec2 start_pos){
-		position = vec3(start_pos(0), BALL_RADIUS/2.0 ,start_pos(1));
-		velocity = vec3(((rand() % 200)-100)/200.0, 2.0*((rand() % 100)/100.0), ((rand() % 200)-100)/200.0);
+		position = vec4((float)start_pos(0), BALL_RADIUS/2.0f, (float)start_pos(1));
+		velocity = vec4(((rand() % 200)-100)/200.0f, 2.0f*((rand() % 100)/100.0f), ((rand() % 200)-100)/200.0f);
 };
 
 void particle::ApplyGravity(int ms){
 	//vec3 velocityChange(0.0f, -(gGravityAccn * ms)/1000.0f, 0.0f);
-	vec3 velocityChange(0.0f, -(4 * ms)/1000.0f, 0.0f);
+	vec4 velocityChange(0.0f, -(4 * ms)/1000.0f, 0.0f);
 	velocity += velocityChange;
 }
 
 bool particle::HaveCollision(){
 	if(position(1)<0) return true;	//touch the ground
-	//TODO:Add more disappear condition
+	//cushions and balls bounce, see particleColliders
 	return false;
 }
 
-void particle::Update(int ms){
-	position += ((velocity * ms)/1000.0f);
+void particle::Update(int ms, const particleColliders *colliders){
+	vec4 from = position;
+	position = velocity.MulAdd(ms/1000.0f, position);
+	if(colliders) colliders->Collide(from, position, velocity);
 	ApplyGravity(ms);
 	if(HaveCollision()) Disappear();
 }
 
 
-void particleSet::Initial(vec2 start_pos){
-		srand(time(NULL));
-		size = rand()%(MAX_PARTICLES - MIN_PARTICLES) + MIN_PARTICLES;
-		cout << size << " particles are allocated." << endl;  
- 		particles = new particle[size];
+void particleSet::Initial(particle *storage, vec2 start_pos, int count){
+		visible = true;
+		size = count;
+		particles = storage;
 		for(int i=0;i<size;i++){
+			particles[i].visible = true;
 			particles[i].Reset(start_pos);
 		}
+		SetBounds(particles[0].position, particles[0].position);
 	}
 
+void particleSet::Moved(particle *storage, int count)
+{
+	particles = storage;
+	size = count;
+}
+
+void particleSet::SetBounds(const vec4 &lo, const vec4 &hi)
+{
+	vec4 c = (lo + hi)*0.5f;
+	vec4 e = hi - c;
+	bounds[0] = c(0);
+	bounds[1] = c(1);
+	bounds[2] = c(2);
+	bounds[3] = sqrtf(e.Dot3(e)) + PARTICLE_RADIUS;
+}
+
 bool particleSet::HasNextParticle()
 {
 	if(!visible) return false;
@@ -297,7 +840,7 @@ bool particleSet::HasNextParticle()
 		invisible_num++;
 	}
 	if(invisible_num==size){
-		delete [] particles;
+		//the particles stay in the manager's pool until it packs them
 		visible = false;
 		return false;
 	}
@@ -312,72 +855,298 @@ particle* particleSet::GetNextParticle(){
 };
 
 
+/*-----------------------------------------------------------
+  particleColliders class members
+  -----------------------------------------------------------*/
+particleColliders::particleColliders():originX(0.0f),originZ(0.0f),invCell(1.0f),cols(0),rows(0),cellStart(1, 0)
+{
+	for(int i=0;i<NUM_CUSHION;i++) planes[i][0] = planes[i][1] = planes[i][2] = 0.0f;
+}
+
+int particleColliders::Cell(float x, float z) const
+{
+	int cx = (int)floorf((x - originX)*invCell);
+	int cz = (int)floorf((z - originZ)*invCell);
+	if(cx<0 || cx>=cols || cz<0 || cz>=rows) return -1;
+	return cz*cols + cx;
+}
+
+void particleColliders::Build(const table &t)
+{
+	//the cushions' extent bounds the grid, so it can be sized once
+	float tMinX = FLT_MAX, tMaxX = -FLT_MAX, tMinZ = FLT_MAX, tMaxZ = -FLT_MAX;
+	for(int i=0;i<NUM_CUSHION;i++)
+	{
+		const cushion &c = t.cushions[i];
+		planes[i][0] = (float)c.normal(0);
+		planes[i][1] = (float)c.normal(1);
+		planes[i][2] = -(float)c.normal.Dot(c.start);
+		const vec2 *ends[2] = {&c.start, &c.end};
+		for(int k=0;k<2;k++)
+		{
+			float x = (float)(*ends[k])(0), z = (float)(*ends[k])(1);
+			if(x<tMinX) tMinX = x;
+			if(x>tMaxX) tMaxX = x;
+			if(z<tMinZ) tMinZ = z;
+			if(z>tMaxZ) tMaxZ = z;
+		}
+	}
+
+	//the grid covers the balls' squares, cells one ball across
+	int n = t.NumBalls();
+	balls.resize(n*3);
+	float minX = FLT_MAX, maxX = -FLT_MAX, minZ = FLT_MAX, maxZ = -FLT_MAX, maxR = 0.0f;
+	for(int i=0;i<n;i++)
+	{
+		const ball &b = t.balls[i];
+		float x = (float)b.position(0), z = (float)b.position(1), r = b.radius;
+		balls[i*3] = x;
+		balls[i*3+1] = z;
+		balls[i*3+2] = r;
+		if(x-r<minX) minX = x-r;
+		if(x+r>maxX) maxX = x+r;
+		if(z-r<minZ) minZ = z-r;
+		if(z+r>maxZ) maxZ = z+r;
+		if(r>maxR) maxR = r;
+	}
+	if(n==0 || maxR<=0.0f)
+	{
+		cols = rows = 0;
+		cellStart.assign(1, 0);
+		cellBalls.clear();
+		return;
+	}
+	//clamped to the table, a ball's radius past the cushions, so the
+	//buffers are reserved for the worst case the first time and a later
+	//spread never allocates. A ball out past that is filed at the edge
+	if(minX<tMinX-maxR) minX = tMinX-maxR;
+	if(maxX>tMaxX+maxR) maxX = tMaxX+maxR;
+	if(minZ<tMinZ-maxR) minZ = tMinZ-maxR;
+	if(maxZ>tMaxZ+maxR) maxZ = tMaxZ+maxR;
+	if(maxX<minX) maxX = minX;
+	if(maxZ<minZ) maxZ = minZ;
+	originX = minX;
+	originZ = minZ;
+	invCell = 1.0f/(2.0f*maxR);
+	int maxCols = (int)((tMaxX - tMinX + 2.0f*maxR)*invCell) + 1;
+	int maxRows = (int)((tMaxZ - tMinZ + 2.0f*maxR)*invCell) + 1;
+	cols = (int)((maxX - minX)*invCell) + 1;
+	rows = (int)((maxZ - minZ)*invCell) + 1;
+	if(cols>maxCols) cols = maxCols;
+	if(rows>maxRows) rows = maxRows;
+	//cells are as wide as the biggest ball, so a ball is in 4 at most
+	cellStart.reserve(maxCols*maxRows+1);
+	cellBalls.reserve(n*4);
+
+	//counting sort : count each cell's balls, sum them so each cell
+	//holds its end, then fill backwards so it ends up holding its start
+	int numCells = cols*rows;
+	cellStart.assign(numCells+1, 0);
+	for(int pass=0;pass<2;pass++)
+	{
+		for(int i=0;i<n;i++)
+		{
+			float x = balls[i*3], z = balls[i*3+1], r = balls[i*3+2];
+			int x0 = (int)floorf((x - r - originX)*invCell), x1 = (int)floorf((x + r - originX)*invCell);
+			int z0 = (int)floorf((z - r - originZ)*invCell), z1 = (int)floorf((z + r - originZ)*invCell);
+			x0 = (x0<0) ? 0 : (x0>=cols) ? cols-1 : x0;
+			x1 = (x1<0) ? 0 : (x1>=cols) ? cols-1 : x1;
+			z0 = (z0<0) ? 0 : (z0>=rows) ? rows-1 : z0;
+			z1 = (z1<0) ? 0 : (z1>=rows) ? rows-1 : z1;
+			for(int cz=z0;cz<=z1;cz++)
+				for(int cx=x0;cx<=x1;cx++)
+				{
+					if(pass==0) cellStart[cz*cols + cx]++;
+					else cellBalls[--cellStart[cz*cols + cx]] = i;
+				}
+		}
+		if(pass==0)
+		{
+			for(int c=1;c<=numCells;c++) cellStart[c] += cellStart[c-1];
+			cellBalls.resize(cellStart[numCells]);
+		}
+	}
+}
+
+void particleColliders::Collide(const vec4 &from, vec4 &position, vec4 &velocity) const
+{
+	//cushions : only a particle that crossed one this step, below its
+	//top; one already outside (over the top and down) stays outside
+	if(position(1) < CUSHION_HEIGHT)
+	{
+		for(int i=0;i<NUM_CUSHION;i++)
+		{
+			const float *p = planes[i];
+			float d = p[0]*position(0) + p[1]*position(2) + p[2];
+			if(d >= 0.0f) continue;
+			if(p[0]*from(0) + p[1]*from(2) + p[2] < 0.0f) continue;
+			position(0) -= p[0]*d;
+			position(2) -= p[1]*d;
+			float vn = p[0]*velocity(0) + p[1]*velocity(2);
+			if(vn<0.0f)
+			{
+				velocity(0) -= p[0]*vn*(1.0f+PARTICLE_RESTITUTION);
+				velocity(2) -= p[1]*vn*(1.0f+PARTICLE_RESTITUTION);
+			}
+		}
+	}
+
+	//balls, as drawn : spheres centred half a radius up
+	int c = Cell(position(0), position(2));
+	if(c<0) return;
+	for(int k=cellStart[c];k<cellStart[c+1];k++)
+	{
+		const float *b = &balls[cellBalls[k]*3];
+		vec4 d(position(0) - b[0], position(1) - BALL_RADIUS/2.0f, position(2) - b[1]);
+		float d2 = d.Dot3(d);
+		if(d2 >= b[2]*b[2] || d2 <= 0.0f) continue;
+		float dist = sqrtf(d2);
+		vec4 n = d/dist;
+		position = n.MulAdd(b[2] - dist, position);
+		float vn = n.Dot3(velocity);
+		if(vn<0.0f) velocity = n.MulAdd(-vn*(1.0f+PARTICLE_RESTITUTION), velocity);
+	}
+}
+
 particleSetMgr* particleSetMgr::_instance = 0;
 
+particleSetMgr::particleSetMgr():particle_set_size(0), pool_head(0), live_particles(0),
+	live_sets(0), spawned(0), peak_particles(0), dropped_particles(0), budget(PARTICLE_BUDGET), quality(1.0f), quality_held(false)
+{
+	pool = new particle[PARTICLE_BUDGET];
+	particle_sets = new particleSet[PARTICLE_BUDGET];
+}
+
+particleSetMgr::~particleSetMgr()
+{
+	delete [] particle_sets;
+	delete [] pool;
+}
 
 particleSetMgr* particleSetMgr::Instance(){
 	if(_instance==0){
-		_instance = new particleSetMgr; 
+		//seeded once here, not per firework
+		srand((unsigned int)time(NULL));
+		//static, so the one manager is never allocated on its own
+		static particleSetMgr instance;
+		_instance = &instance;
 	}
 	return _instance;
 }
 
-void particleSetMgr::Firework(vec2 position)
+int particleSetMgr::Firework(vec2 position, float impulse)
 {	
-	if( particle_set_size>=particle_set_num ){
-		particle_set_num *= PARTICLE_SET_SCALE;
-		particleSet *temp_particles = new particleSet[particle_set_num];
-		cout << "Newed:" << particle_set_num <<endl;
-		memcpy(temp_particles, particle_sets, sizeof(particleSet)*particle_set_size);
-		delete [] particle_sets;
-		particle_sets = temp_particles;
-	};
-	particle_sets[particle_set_size++].Initial(position);
-	cout << "Firework happend " << particle_set_size <<endl;
-	
+	//what the hit asks for : the old random 10-100, scaled by how hard
+	//it was and by the frame time
+	float strength = impulse/PARTICLE_FULL_IMPULSE;
+	if(strength>1.0f) strength = 1.0f;
+	int wanted = (int)((rand()%(MAX_PARTICLES - MIN_PARTICLES) + MIN_PARTICLES)*strength);
+	int count = (int)(wanted*quality);
+
+	//what the budget allows : everything while it is under half used,
+	//then a share that shrinks to nothing as it fills up
+	int left = budget - (live_particles + spawned);
+	if(left < budget/2)
+	{
+		int allowed = (left>0) ? (int)(((float)count*left)/(budget/2)) : 0;
+		if(count>allowed) count = allowed;
+	}
+	//the pool is packed, so this only bites if the budget is the pool's
+	if(count>PARTICLE_BUDGET - pool_head) count = PARTICLE_BUDGET - pool_head;
+	if(count<MIN_PARTICLES/2) count = 0;
+	dropped_particles += wanted - count;
+	if(count==0) return 0;
+
+	particle_sets[particle_set_size++].Initial(pool + pool_head, position, count);
+	pool_head += count;
+	spawned += count;
+	MetricAdd(METRIC_FIREWORKS);
+	MetricAdd(METRIC_PARTICLES_SPAWNED, count);
+	if(live_particles + spawned > peak_particles) peak_particles = live_particles + spawned;
+	return count;
+}
+
+void particleSetMgr::HoldQuality(bool hold, float q)
+{
+	quality_held = hold;
+	if(hold) quality = (q<PARTICLE_MIN_QUALITY) ? PARTICLE_MIN_QUALITY : (q>1.0f) ? 1.0f : q;
 }
 
-void particleSetMgr::Update(int ms)
+void particleSetMgr::FrameTime(float ms)
+{
+	if(quality_held) return;
+	//cut in proportion to how far a slow frame was over, so twice the
+	//target halves emission and a near miss barely touches it; win it
+	//back slowly
+	if(ms>PARTICLE_FRAME_TARGET) quality *= PARTICLE_FRAME_TARGET/ms;
+	else quality += 0.02f;
+	if(quality>1.0f) quality = 1.0f;
+	if(quality<PARTICLE_MIN_QUALITY) quality = PARTICLE_MIN_QUALITY;
+}
+
+void particleSetMgr::Fireworks(const collisionEvent *e, int count)
+{
+	for(int i=0;i<count;i++) Firework(e[i].position, e[i].impulse);
+}
+
+void particleSetMgr::Update(int ms, const table &t)
 {	
+	live_particles = 0;
+	live_sets = 0;
+	spawned = 0;
 	if(particle_set_size > 0){
-		particleSet* ps;
-		particle* p;
-		for(ParticleSetBegin();HasNextParticleSet();){
-			ps = GetNextParticleSet();
-			for(ps->ParticleIteratorBegin();ps->HasNextParticle();){
-				p = ps->GetNextParticle();
-				p->Update(ms);	
+		//once per step, shared by every particle
+		colliders.Build(t);
+		//the sets are packed in order, so the live particles written at
+		//out never pass the ones still to be read, nor the sets at sets
+		particle *out = pool;
+		int sets = 0;
+		int reclaimed = 0;
+		for(int s=0;s<particle_set_size;s++){
+			particleSet *ps = particle_sets + s;
+			particle *first = out;
+			//refit the set's bounds as it moves, for the renderer to cull
+			vec4 lo(FLT_MAX), hi(-FLT_MAX);
+			for(int i=0;i<ps->GetSize();i++){
+				particle *p = ps->particles + i;
+				if(!p->visible) continue;
+				p->Update(ms, &colliders);	
+				if(!p->visible)
+				{
+					reclaimed++;
+					continue;
+				}
+				for(int k=0;k<3;k++)
+				{
+					if(p->position(k)<lo(k)) lo(k) = p->position(k);
+					if(p->position(k)>hi(k)) hi(k) = p->position(k);
+				}
+				if(out!=p) *out = *p;
+				out++;
 			}
+			int live = (int)(out - first);
+			if(live==0) continue;
+			if(sets!=s) particle_sets[sets] = *ps;
+			particle_sets[sets].Moved(first, live);
+			particle_sets[sets++].SetBounds(lo, hi);
+			live_particles += live;
 		}
+		particle_set_size = sets;
+		live_sets = sets;
+		pool_head = (int)(out - pool);
+		if(reclaimed) MetricAdd(METRIC_PARTICLES_RECLAIMED, reclaimed);
 	}
 }
 
 void particleSetMgr::ParticleSetBegin()
 {
 	index = 0;
-	invisible_num = 0;
-}
-
-
-void particleSetMgr::ResetVisible(){
-	for(int i=0;i<particle_set_size;i++)
-		particle_sets[i].SetVisible();
 }
 
 bool particleSetMgr::HasNextParticleSet()
 {
-	while(index<particle_set_size && particle_sets[index].AllInvisible()){
-		index++;
-		invisible_num++;
-	}
-	if(invisible_num!=0 && invisible_num==particle_set_size){		
-		ResetVisible();
-		particle_set_size = 0;	//no need to delete, just reset the index	
-		return false;
-	}
-	if(index>=particle_set_size) return false;
-	 
-	return true;
+	while(index<particle_set_size && particle_sets[index].AllInvisible()) index++;
+	return index<particle_set_size;
 }
 
 particleSet* particleSetMgr::GetNextParticleSet(){
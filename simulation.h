@@ -1,10 +1,16 @@
 /*-----------------------------------------------------------
   Simulation Header File
   -----------------------------------------------------------*/
+#ifndef simulation_h_included
+#define simulation_h_included
+
 #include <assert.h>
 #include"vecmath.h"
+#include"narrowphase.h"
 #include <time.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <vector>
 
 /*-----------------------------------------------------------
   Macros
@@ -15,13 +21,40 @@
 #define BALL_MASS		(0.1f)
 #define TWO_PI			(6.2832f)
 #define	SIM_UPDATE_MS	(10)
-#define NUM_BALLS		(7)		
+#define NUM_BALLS		(7)		//balls in the standard game
 #define NUM_CUSHION		(4)
 #define MAX_PARTICLES	(100)
 #define MIN_PARTICLES	(10)
 #define MAX_SPEED		(200)
-#define PARTICLE_SET_SCALE	(2)
 #define PARTICLE_RADIUS	(0.002f)
+#define PARTICLE_BUDGET			(5000)		//particles alive at once, all fireworks
+#define PARTICLE_FULL_IMPULSE	(0.4f)		//kg m/s : hits this hard get a full firework
+#define PARTICLE_FRAME_TARGET	(25.0f)		//ms, slower frames cut emission
+#define PARTICLE_MIN_QUALITY	(0.1f)		//emission is never cut below this share
+#define PARTICLE_RESTITUTION	(0.5f)		//fraction of the normal speed kept off cushions and balls
+#define CUSHION_HEIGHT			(0.1f)		//m, as drawn : particles above it fly over
+#define SMALL_VELOCITY		(0.01f)
+#define CUE_BALL_FACTOR		(8.0f)		//cue power to cue ball speed
+#define HASH_POSITION_STEP	(0.0001)	//state hash quantisation, m
+#define HASH_VELOCITY_STEP	(0.0001)	//and m/s
+#define RACK_SEPARATION		(BALL_RADIUS*3.0f)	//centres across a rack row
+#define RACK_ROW_SEPARATION	(BALL_RADIUS*2.5f)	//between rack rows
+#define SCATTER_CELL		(BALL_RADIUS*3.0f)	//scatter layout grid spacing
+#define CCD_MAX_TRAVEL		(BALL_RADIUS)		//furthest a ball moves in one (sub-)step, at any speed
+#define BROADPHASE_CELL		(BALL_RADIUS*2.0f+CCD_MAX_TRAVEL)	//grid cell, m : a ball and its reach in a step
+#define BROADPHASE_PAIRS	(4)		//candidate pairs per ball the buffers start with
+#ifndef BROADPHASE_MIN_BALLS
+#define BROADPHASE_MIN_BALLS	(32)	//smaller tables just scan every ball
+#endif
+
+/*-----------------------------------------------------------
+  table layouts
+  -----------------------------------------------------------*/
+enum tableLayout
+{
+	LAYOUT_RACK,	//cue ball at the top, the rest in a triangle
+	LAYOUT_SCATTER	//every ball at a random, non-overlapping spot
+};
 
 /*-----------------------------------------------------------
   plane normals
@@ -31,6 +64,13 @@ extern vec2	gPlaneNormal_Top;
 extern vec2	gPlaneNormal_Right;
 extern vec2	gPlaneNormal_Bottom;
 
+/*-----------------------------------------------------------
+  physics coefficients
+  -----------------------------------------------------------*/
+extern float gCoeffRestitution;
+extern float gCoeffFriction;
+extern float gGravityAccn;
+
 /*-----------------------------------------------------------
   cushion class
   -----------------------------------------------------------*/
@@ -45,6 +85,43 @@ public:
 	vec2 GetNormal(void);
 };
 
+/*-----------------------------------------------------------
+  rectangular table bounds
+  a table's own cushions are axis aligned, so against these a
+  ball only needs coordinate comparisons
+  -----------------------------------------------------------*/
+struct rectBounds
+{
+	double minX;
+	double maxX;
+	double minZ;
+	double maxZ;
+};
+
+/*-----------------------------------------------------------
+  collision events
+  the solver records each hit rather than acting on it, and
+  effects, sound and statistics read a step's events in bulk
+  once table::Update has returned
+  -----------------------------------------------------------*/
+enum collisionType
+{
+	COLLISION_CUSHION,
+	COLLISION_BALL
+};
+
+struct collisionEvent
+{
+	int				type;		//collisionType
+	int				a;			//the ball
+	int				b;			//the other ball, or the cushion
+	vec2			position;	//point of contact
+	float			impulse;	//magnitude of the change in a's momentum
+	unsigned int	step;		//table::Steps() when it happened
+};
+
+class particleColliders;
+
 /*----------------------------------------------------------
   particle class
  ----------------------------------------------------------*/
@@ -52,13 +129,15 @@ public:
 class particle
 {
 private:
-	vec3 velocity;
+	vec4 velocity;
 	 
 public:
-	vec3 position;
+	vec4 position;
 	float radius;
 	bool visible;
 
+	VECMATH_ALIGNED_NEW
+
 	particle():radius(PARTICLE_RADIUS), visible(true){};
 
 	void Disappear(){ 
@@ -66,7 +145,7 @@ public:
 	}
 	void Reset(const vec2);
 	void ApplyGravity(int ms);
-	void Update(int ms);
+	void Update(int ms, const particleColliders *colliders = 0);
 	bool HaveCollision();
 
 };
@@ -79,12 +158,20 @@ private:
 	int size;
 	int particle_index;
 	int invisible_num;
+	float bounds[4];	//sphere round the live particles : centre, radius
 
 public:
 	particle *particles;
 
-	particleSet():visible(true),size(0){};
-	void Initial(vec2 start_pos);
+	particleSet():visible(true),size(0),particles(0){};
+	//count particles at start_pos, in storage the manager owns
+	void Initial(particle *storage, vec2 start_pos, int count);
+	//the manager has packed the count live particles into storage
+	void Moved(particle *storage, int count);
+	//refit the bounding sphere to the box lo..hi
+	void SetBounds(const vec4 &lo, const vec4 &hi);
+	vec4 BoundsCentre(void) const {return vec4(bounds[0],bounds[1],bounds[2]);}
+	float BoundsRadius(void) const {return bounds[3];}
 	
 	void ParticleIteratorBegin(){ particle_index = 0; invisible_num = 0; }
 	bool HasNextParticle();
@@ -102,7 +189,6 @@ public:
 
 class ball
 {
-	static int ballIndexCnt;
 public:
 	vec2	position;
 	vec2	velocity;
@@ -111,20 +197,25 @@ public:
 	int		index;
 	
 	ball(): position(0.0), velocity(0.0), radius(BALL_RADIUS), 
-		mass(BALL_MASS){index = ballIndexCnt++; Reset();}
+		mass(BALL_MASS), index(0){}
 	
-	void Reset(void);
 	void ApplyImpulse(vec2 imp);
 	void ApplyFrictionForce(int ms);
-	void DoPlaneCollisions(cushion* c);
-	void DoBallCollision(ball &b);
+	//each hit is written to out (room for NUM_CUSHION events for the
+	//planes, one for a ball); they return the number of hits
+	int DoPlaneCollisions(cushion* c, collisionEvent *out);
+	int DoRectPlaneCollisions(const rectBounds &bounds, collisionEvent *out);
+	bool DoBallCollision(ball &b, collisionEvent *out);
 	void Update(int ms);
+	void Advance(double seconds);
 	
 	bool HasHitPlane(cushion &c) const;
 	bool HasHitBall(const ball &b) const;
 
-	void HitPlane(cushion &c);
-	void HitBall(ball &b);
+	//these return the magnitude of the impulse on this ball
+	float HitPlane(cushion &c);
+	float HitRectPlane(int axis);
+	float HitBall(ball &b);
 
 	vec2 CollisionPos(const ball &b) const;
 	vec2 CollisionPos(const cushion &c) const;
@@ -132,51 +223,212 @@ public:
 };
 
 
+/*-----------------------------------------------------------
+  table state in plain data
+  everything that changes as the table is simulated, so a
+  table can be saved and restored with memcpy. radius, mass
+  and the cushions are fixed for a table and not included,
+  nor are particles : they are effects, not table state
+  -----------------------------------------------------------*/
+struct ballState
+{
+	double		position[2];
+	double		velocity[2];
+	uint64_t	hash;		//the ball's share of the state hash
+};
+
+//the active list is saved beside the header, activeCount entries
+struct snapshotHeader
+{
+	unsigned int	version;
+	uint64_t		hash;
+	int				activeCount;
+};
+
 /*-----------------------------------------------------------
   table class
+  The number of balls is fixed when the table is built and
+  the balls are stored contiguously. Tables too big for the
+  standard cloth are scaled up, keeping its proportions, so
+  that the layout fits inside the cushions.
   -----------------------------------------------------------*/
 class table
 {
+	narrowPhase narrow;
+	std::vector<ballPair> hits;
+	bool rectangular;	//cushions match bounds, use the closed form path
+	rectBounds bounds;
+	double scale;		//of the cloth against the standard table
+	tableLayout layout;
+	unsigned int seed;	//for the scatter layout
+	int64_t scatterCols;	//and its grid
+	int64_t scatterRows;
+	int64_t scatterStride;
+	std::vector<int> activeList;	//indices of the moving balls
+	int activeCount;
+	std::vector<char> isActive;
+	std::vector<char> isFast;	//being sub-stepped this step
+	std::vector<int> fastList;
+	int numFast;
+	unsigned int version;	//bumped whenever any ball state changes
+	unsigned int steps;		//Update calls that moved something
+	std::vector<collisionEvent> events;	//the last step's, grown ahead of need
+	int numEvents;
+	uint64_t hash;			//zobrist hash of the quantised ball state
+	std::vector<uint64_t> ballHash;	//each ball's share of it
+	//broadphase : a uniform grid over the cloth, each ball filed
+	//in the cell its centre is in, the cells' balls in linked lists.
+	//Sleeping balls don't move, so a step only refiles the moving ones.
+	//Small tables scan every ball instead, which is cheaper
+	bool useGrid;
+	double gridMinX, gridMinZ;
+	double gridInvCell;
+	int gridCols, gridRows;
+	std::vector<int> cellFirst;		//first ball in each cell, -1 if none
+	std::vector<int> ballCell;		//and each ball's cell and neighbours in it
+	std::vector<int> ballNext;
+	std::vector<int> ballPrev;
+	std::vector<int> candidates;	//one ball's, room for every ball
+	float maxRadius;
+
+	void Wake(int i);
+	void Sleep(int slot);
+	void ReserveEvents(int count);
+	//fast : the fast list in a sub-step, otherwise the rest of the active set
+	void PlaneCollisions(bool fast);
+	int BallCollisions(bool fast, double seconds, double stepSeconds);
+	void Rehash(int i);
+	void Refile(int i);
+	void RefileAll(void);
+	int Candidates(int i, double range);
+	double FitScale(int numBalls) const;
+	vec2 LayoutPosition(int i) const;
+
 public:
-	ball balls[NUM_BALLS];	
+	std::vector<ball> balls;	
 	cushion cushions[NUM_CUSHION];
 
-	table(){	
-		cushions[0].SetPosition(TABLE_X, TABLE_Z, -TABLE_X, TABLE_Z);
-		cushions[1].SetPosition(-TABLE_X, TABLE_Z, -TABLE_X, -TABLE_Z);
-		cushions[2].SetPosition(-TABLE_X, -TABLE_Z, TABLE_X, -TABLE_Z);
-		cushions[3].SetPosition(TABLE_X, -TABLE_Z, TABLE_X, TABLE_Z);
-	}
+	table(int numBalls = NUM_BALLS, tableLayout l = LAYOUT_RACK, unsigned int s = 0);
 	
+	//call after moving any cushion
+	void DetectRectangular(void);
 	void Update(int ms);	
 	bool AnyBallsMoving(void) const;
+	int NumBalls(void) const {return (int)balls.size();}
+	int NumActive(void) const {return activeCount;}
+	double Scale(void) const {return scale;}
+	const rectBounds &Bounds(void) const {return bounds;}
+	unsigned int Version(void) const {return version;}
+	unsigned int Steps(void) const {return steps;}
+	//bytes a step can touch : the table itself, its balls and its
+	//per table buffers
+	size_t Footprint(void) const;
+	//the collisions of the last Update, in the order they were
+	//resolved; valid until the next Update
+	const collisionEvent *Events(void) const {return numEvents ? &events[0] : 0;}
+	int NumEvents(void) const {return numEvents;}
+	//kept up to date incrementally by Update, ApplyImpulse and Reset;
+	//call RehashAll after editing balls directly, which also refiles
+	//them in the broadphase
+	uint64_t StateHash(void) const {return hash;}
+	void RehashAll(void);
+
+	//raw state access for snapshots, balls [first, first+count).
+	//activeList has room for NumActive() entries
+	void SaveHeader(snapshotHeader &h, int *activeList) const;
+	void SaveBalls(int first, int count, ballState *out) const;
+	void RestoreHeader(const snapshotHeader &h, const int *activeList);
+	void RestoreBalls(int first, int count, const ballState *in);
+
+	//balls must be set moving through the table so that they join
+	//the active set
+	void ApplyImpulse(int i, vec2 imp);
+	//place a ball and set it moving (or stop it) in one go
+	void SetBall(int i, vec2 pos, vec2 vel);
+	//back to the table's layout, at rest
+	void Reset(void);
+};
+
+/*-----------------------------------------------------------
+  particleColliders class
+  What particles bounce off, built once per step from a table
+  so each particle does a fixed amount of work : the cushions
+  as precomputed half-planes, and the balls bucketed into a
+  uniform grid with cells a ball across. A ball is entered in
+  every cell its square touches, so a particle only looks at
+  the balls listed in its own cell.
+  -----------------------------------------------------------*/
+class particleColliders
+{
+private:
+	float planes[NUM_CUSHION][3];	//inward normal x, z and offset
+	float originX, originZ;
+	float invCell;
+	int cols, rows;
+	std::vector<int> cellStart;		//cols*rows+1, into cellBalls
+	std::vector<int> cellBalls;
+	std::vector<float> balls;		//x, z, radius per ball
+
+	int Cell(float x, float z) const;
+
+public:
+	particleColliders();
+	void Build(const table &t);
+	//bounce a particle that moved from 'from' across a cushion or
+	//into a ball
+	void Collide(const vec4 &from, vec4 &position, vec4 &velocity) const;
 };
 
 //this class is used to manager the multiple particles' set
-//this should be a singleton
+//this should be a singleton. Everything it needs is made up front,
+//so a frame never allocates : the particles come from one pool of
+//PARTICLE_BUDGET, the sets' runs packed in order from its start.
+//Update slides the live particles down over the dead ones as it
+//moves them, and a firework goes on the end
 class particleSetMgr
 {
 private:
-	int particle_set_num;	//the number of slots
-	int particle_set_size;	//the size
+	int particle_set_size;	//the sets, all with live particles after Update
+	int pool_head;		//the end of the packed particles
+	particle *pool;
 	static particleSetMgr* _instance;
 	int index;
-	int invisible_num;
+	int live_particles;	//visible particles after the last Update
+	int live_sets;		//and the sets they are in
+	int spawned;		//since the last Update
+	int peak_particles;
+	long dropped_particles;	//asked for but not emitted, budget or frame time
+	int budget;
+	float quality;		//0..1, backs off while frames are slow
+	bool quality_held;	//FrameTime leaves it alone
+	particleColliders colliders;
 
 public:
-	particleSet *particle_sets;
+	particleSet *particle_sets;	//PARTICLE_BUDGET slots, a set has a particle at least
 
-	particleSetMgr():particle_set_num(PARTICLE_SET_SCALE), particle_set_size(0){
-	particle_sets = new particleSet[particle_set_num];
-}
-	~particleSetMgr(){ delete [] particle_sets; }
+	particleSetMgr();
+	~particleSetMgr();
 	static particleSetMgr* Instance();
-	void Update(int ms);
-	void Firework(vec2 position);
+	//move the particles, bouncing them off t's cushions and balls
+	void Update(int ms, const table &t);
+	//a firework sized by the impulse of the hit, the budget left and
+	//the frame time; returns the particles emitted
+	int Firework(vec2 position, float impulse = PARTICLE_FULL_IMPULSE);
+	//a firework for every event
+	void Fireworks(const collisionEvent *e, int count);
+	//the last frame's time, emission backs off while it is over target
+	void FrameTime(float ms);
+	//pin the quality at q, e.g. for a repeatable run; false lets it adapt again
+	void HoldQuality(bool hold, float q = 1.0f);
+	//no more than the pool holds
+	void SetBudget(int n){ budget = (n<PARTICLE_BUDGET) ? n : PARTICLE_BUDGET; }
 	void ParticleSetBegin();
 	bool HasNextParticleSet();
-	void ResetVisible();
 	particleSet* GetNextParticleSet();
+	int LiveParticles(){ return live_particles; }
+	int LiveParticleSets(){ return live_sets; }
+	int PeakParticles(){ return peak_particles; }
+	long DroppedParticles(){ return dropped_particles; }
 
 };
 
@@ -188,3 +440,4 @@ public:
 extern table gTable;
 //extern particleSetMgr gParticleSetMgr;
 
+#endif
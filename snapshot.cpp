@@ -0,0 +1,178 @@
+/*-----------------------------------------------------------
+  Snapshot Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"snapshot.h"
+#include <string.h>
+
+/*-----------------------------------------------------------
+  tableSnapshot class members
+  -----------------------------------------------------------*/
+//the balls follow the active list, rounded up to a whole word
+static size_t BallsOffset(int numBalls)
+{
+	size_t n = sizeof(snapshotHeader) + sizeof(int)*(numBalls+1);
+	return (n+7) & ~(size_t)7;
+}
+
+tableSnapshot::tableSnapshot():blob(0),bytes(0)
+{
+}
+
+tableSnapshot::tableSnapshot(const tableSnapshot &x):blob(0),bytes(0)
+{
+	*this = x;
+}
+
+tableSnapshot::~tableSnapshot()
+{
+	delete [] blob;
+}
+
+void tableSnapshot::Size(int numBalls)
+{
+	size_t n = BallsOffset(numBalls) + sizeof(ballState)*numBalls;
+	if(blob && n==bytes) return;
+	delete [] blob;
+	bytes = n;
+	blob = new uint64_t[(n+7)/8];
+	Header()->numBalls = numBalls;
+}
+
+ballState *tableSnapshot::Balls(void) const
+{
+	return (ballState *)((char *)blob + BallsOffset(Header()->numBalls));
+}
+
+tableSnapshot &tableSnapshot::operator =(const tableSnapshot &x)
+{
+	if(this==&x) return (*this);
+	if(!x.blob)
+	{
+		delete [] blob;
+		blob = 0;
+		bytes = 0;
+		return (*this);
+	}
+	Size(x.NumBalls());
+	memcpy(blob, x.blob, bytes);
+	return (*this);
+}
+
+void tableSnapshot::Save(const table &t)
+{
+	Size(t.NumBalls());
+	t.SaveHeader(Header()->header, Active());
+	t.SaveBalls(0, t.NumBalls(), Balls());
+}
+
+void tableSnapshot::Restore(table &t) const
+{
+	if(!blob) return;
+	assert(NumBalls()==t.NumBalls());
+	t.RestoreBalls(0, NumBalls(), Balls());
+	t.RestoreHeader(Header()->header, Active());
+}
+
+/*-----------------------------------------------------------
+  cowSnapshot class members
+  -----------------------------------------------------------*/
+cowSnapshot::cowSnapshot():numBalls(0)
+{
+}
+
+cowSnapshot::cowSnapshot(const cowSnapshot &x):numBalls(0)
+{
+	*this = x;
+}
+
+cowSnapshot::~cowSnapshot()
+{
+	Release();
+}
+
+void cowSnapshot::Release(void)
+{
+	for(int i=0;i<(int)blocks.size();i++)
+	{
+		if(blocks[i] && --blocks[i]->refs==0) delete blocks[i];
+		blocks[i] = 0;
+	}
+}
+
+cowSnapshot &cowSnapshot::operator =(const cowSnapshot &x)
+{
+	if(this==&x) return (*this);
+	//take the new references before dropping ours, in case we share
+	for(int i=0;i<(int)x.blocks.size();i++) if(x.blocks[i]) x.blocks[i]->refs++;
+	Release();
+	header = x.header;
+	active = x.active;
+	numBalls = x.numBalls;
+	blocks = x.blocks;
+	return (*this);
+}
+
+void cowSnapshot::Save(const table &t, const cowSnapshot *parent)
+{
+	//a different size of table shares nothing
+	if(numBalls!=t.NumBalls())
+	{
+		Release();
+		numBalls = t.NumBalls();
+		blocks.assign((numBalls+SNAPSHOT_BLOCK_BALLS-1)/SNAPSHOT_BLOCK_BALLS, (block *)0);
+	}
+	if(parent && parent->numBalls!=numBalls) parent = 0;
+	//only the moving balls, so a fork copies no more of the list
+	//than it needs
+	active.resize(t.NumActive());
+	t.SaveHeader(header, active.data());
+	for(int i=0;i<(int)blocks.size();i++)
+	{
+		int first = i*SNAPSHOT_BLOCK_BALLS;
+		int count = numBalls - first;
+		if(count>SNAPSHOT_BLOCK_BALLS) count = SNAPSHOT_BLOCK_BALLS;
+
+		ballState state[SNAPSHOT_BLOCK_BALLS];
+		t.SaveBalls(first, count, state);
+
+		block *shared = parent ? parent->blocks[i] : 0;
+		if(shared && memcmp(shared->balls, state, sizeof(ballState)*count)==0)
+		{
+			if(blocks[i]==shared) continue;
+			shared->refs++;
+			if(blocks[i] && --blocks[i]->refs==0) delete blocks[i];
+			blocks[i] = shared;
+			continue;
+		}
+		//write : reuse our block only if nobody else can see it
+		if(!blocks[i] || blocks[i]->refs>1)
+		{
+			if(blocks[i]) blocks[i]->refs--;
+			blocks[i] = new block;
+			blocks[i]->refs = 1;
+		}
+		memcpy(blocks[i]->balls, state, sizeof(ballState)*count);
+	}
+}
+
+void cowSnapshot::Restore(table &t) const
+{
+	for(int i=0;i<(int)blocks.size();i++)
+	{
+		if(!blocks[i]) continue;
+		int first = i*SNAPSHOT_BLOCK_BALLS;
+		int count = numBalls - first;
+		if(count>SNAPSHOT_BLOCK_BALLS) count = SNAPSHOT_BLOCK_BALLS;
+		t.RestoreBalls(first, count, blocks[i]->balls);
+	}
+	t.RestoreHeader(header, active.data());
+}
+
+int cowSnapshot::SharedBlocks(const cowSnapshot &x) const
+{
+	int n = 0;
+	if(numBalls!=x.numBalls) return 0;
+	for(int i=0;i<(int)blocks.size();i++) if(blocks[i] && blocks[i]==x.blocks[i]) n++;
+	return n;
+}
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------
+  Snapshot Header File
+  Cheap save and restore of table state, for searches that
+  fork the table many times.
+  -----------------------------------------------------------*/
+#ifndef snapshot_h_included
+#define snapshot_h_included
+
+#include"simulation.h"
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define SNAPSHOT_BLOCK_BALLS	(8)
+
+/*-----------------------------------------------------------
+  tableSnapshot class
+  The whole table state as one block of POD : a header, then
+  the active list, then the balls. The block is the same
+  size for every table of the same size, so copying one
+  snapshot over another is a single memcpy, and so is
+  writing it out. Once sized for a table, saving again
+  reuses the block.
+  -----------------------------------------------------------*/
+class tableSnapshot
+{
+private:
+	struct blobHeader
+	{
+		snapshotHeader	header;
+		int				numBalls;
+	};
+	uint64_t *blob;		//8 byte words, so ballState is aligned
+	size_t bytes;
+
+	void Size(int numBalls);
+	blobHeader *Header(void) const {return (blobHeader *)blob;}
+	int *Active(void) const {return (int *)(Header()+1);}
+	ballState *Balls(void) const;
+
+public:
+	tableSnapshot();
+	tableSnapshot(const tableSnapshot &x);
+	~tableSnapshot();
+	tableSnapshot &operator =(const tableSnapshot &x);
+
+	void Save(const table &t);
+	void Restore(table &t) const;
+	int NumBalls(void) const {return blob ? Header()->numBalls : 0;}
+	//the block, Bytes() long; a snapshot of the same size can be
+	//copied onto it with memcpy
+	void *Data(void) {return blob;}
+	const void *Data(void) const {return blob;}
+	size_t Bytes(void) const {return bytes;}
+};
+
+/*-----------------------------------------------------------
+  cowSnapshot class
+  Copy on write snapshot : ball state is held in reference
+  counted blocks of SNAPSHOT_BLOCK_BALLS balls. Copying a
+  cowSnapshot (forking) only bumps the counts, and saving a
+  table against a parent snapshot shares every block whose
+  balls have not changed, so the children of a position
+  only pay for the balls their shot moved.
+  Reference counts are not atomic : keep a family of
+  snapshots on one thread.
+  -----------------------------------------------------------*/
+class cowSnapshot
+{
+private:
+	struct block
+	{
+		int			refs;
+		ballState	balls[SNAPSHOT_BLOCK_BALLS];
+	};
+	snapshotHeader header;
+	std::vector<int> active;
+	std::vector<block *> blocks;
+	int numBalls;
+
+	void Release(void);
+
+public:
+	cowSnapshot();
+	cowSnapshot(const cowSnapshot &x);
+	~cowSnapshot();
+	cowSnapshot &operator =(const cowSnapshot &x);
+
+	//parent may be 0, otherwise unchanged blocks are shared with it
+	void Save(const table &t, const cowSnapshot *parent = 0);
+	void Restore(table &t) const;
+	//number of blocks held in common with another snapshot
+	int SharedBlocks(const cowSnapshot &x) const;
+	int NumBlocks(void) const {return (int)blocks.size();}
+};
+
+#endif
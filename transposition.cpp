@@ -0,0 +1,176 @@
+/*-----------------------------------------------------------
+  Transposition Cache Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"transposition.h"
+#include <string.h>
+
+/*-----------------------------------------------------------
+  shotCache class members
+  -----------------------------------------------------------*/
+shotCache::shotCache(int mb):warned(false),hits(0),misses(0),evictions(0),refused(0)
+{
+	//the position pool holds TT_SHARDS*setsPerShard*TT_WAYS outcomes;
+	//big tables get fewer sets, and tables too big for even one set
+	//per shard are refused
+	size_t wayBytes = (size_t)TT_SHARDS*TT_WAYS*sizeof(vec2);
+	int mostBalls = (int)(TT_POSITION_BYTES/wayBytes);
+	if(mb>mostBalls) printf("shot cache : %d balls is over the %d the cache can hold, bigger tables are not cached\n", mb, mostBalls);
+	maxBalls = (mb<1) ? 1 : (mb>mostBalls) ? mostBalls : mb;
+	setsPerShard = (int)(TT_POSITION_BYTES/(wayBytes*maxBalls));
+	if(setsPerShard>TT_SETS_PER_SHARD) setsPerShard = TT_SETS_PER_SHARD;
+
+	shards = new shard[TT_SHARDS];
+	positions = new vec2[(size_t)TT_SHARDS*setsPerShard*TT_WAYS*maxBalls];
+	vec2 *p = positions;
+	for(int s=0;s<TT_SHARDS;s++)
+	{
+		shards[s].sets = new set[setsPerShard];
+		for(int i=0;i<setsPerShard;i++)
+		{
+			for(int w=0;w<TT_WAYS;w++, p+=maxBalls) shards[s].sets[i].ways[w].positions = p;
+		}
+	}
+	Clear();
+}
+
+shotCache::~shotCache()
+{
+	for(int s=0;s<TT_SHARDS;s++) delete [] shards[s].sets;
+	delete [] shards;
+	delete [] positions;
+}
+
+void shotCache::Clear(void)
+{
+	for(int s=0;s<TT_SHARDS;s++)
+	{
+		std::lock_guard<std::mutex> guard(shards[s].lock);
+		for(int i=0;i<setsPerShard;i++)
+		{
+			shards[s].sets[i].hand = 0;
+			for(int w=0;w<TT_WAYS;w++) shards[s].sets[i].ways[w].valid = false;
+		}
+	}
+}
+
+uint64_t shotCache::Key(uint64_t stateHash, float angle, float power, float ballFactor)
+{
+	uint64_t a = (uint64_t)(int64_t)floor((angle/TT_ANGLE_STEP) + 0.5f);
+	uint64_t p = (uint64_t)(int64_t)floor((power/TT_POWER_STEP) + 0.5f);
+	//the factor is used as given, not snapped, so key on its exact bits
+	uint32_t f;
+	memcpy(&f, &ballFactor, sizeof(f));
+	uint64_t k = stateHash ^ (a * 0x9e3779b97f4a7c15ULL) ^ (p * 0xc2b2ae3d27d4eb4fULL) ^ ((f + 1ULL) * 0x165667b19e3779f9ULL);
+	//finalise so that neighbouring shots spread over the shards
+	k ^= k >> 33; k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+shotCache::set &shotCache::SetFor(uint64_t key, std::mutex *&lock)
+{
+	shard &s = shards[key % TT_SHARDS];
+	lock = &s.lock;
+	return s.sets[(key / TT_SHARDS) % setsPerShard];
+}
+
+bool shotCache::Lookup(uint64_t key, shotOutcome &out)
+{
+	std::mutex *lock;
+	set &st = SetFor(key, lock);
+	std::lock_guard<std::mutex> guard(*lock);
+	for(int w=0;w<TT_WAYS;w++)
+	{
+		entry &e = st.ways[w];
+		if(e.valid && e.key==key)
+		{
+			e.referenced = true;
+			out.numBalls = e.numBalls;
+			out.positions.assign(e.positions, e.positions+e.numBalls);
+			out.steps = e.steps;
+			out.stateHash = e.stateHash;
+			hits++;
+			return true;
+		}
+	}
+	misses++;
+	return false;
+}
+
+void shotCache::Insert(uint64_t key, const shotOutcome &outcome)
+{
+	if(outcome.numBalls>maxBalls)
+	{
+		if(!warned.exchange(true)) printf("shot cache : not caching %d ball outcomes, the cache was built for %d\n", outcome.numBalls, maxBalls);
+		refused++;
+		return;
+	}
+	std::mutex *lock;
+	set &st = SetFor(key, lock);
+	std::lock_guard<std::mutex> guard(*lock);
+
+	entry *victim = 0;
+	for(int w=0;w<TT_WAYS && !victim;w++)
+	{
+		//already there (another thread got it first), or a free way
+		if(st.ways[w].valid && st.ways[w].key==key) victim = &st.ways[w];
+	}
+	for(int w=0;w<TT_WAYS && !victim;w++)
+	{
+		if(!st.ways[w].valid) victim = &st.ways[w];
+	}
+	if(!victim)
+	{
+		//clock : skip (and clear) recently used entries
+		while(st.ways[st.hand].referenced)
+		{
+			st.ways[st.hand].referenced = false;
+			st.hand = (st.hand+1) % TT_WAYS;
+		}
+		victim = &st.ways[st.hand];
+		st.hand = (st.hand+1) % TT_WAYS;
+		evictions++;
+	}
+	victim->key = key;
+	victim->valid = true;
+	victim->referenced = false;
+	victim->numBalls = outcome.numBalls;
+	victim->steps = outcome.steps;
+	victim->stateHash = outcome.stateHash;
+	for(int i=0;i<outcome.numBalls;i++) victim->positions[i] = outcome.positions[i];
+}
+
+/*-----------------------------------------------------------
+  shot simulation
+  -----------------------------------------------------------*/
+void SimulateShot(const table &t, float angle, float power, float ballFactor, shotOutcome &out, shotCache *cache)
+{
+	uint64_t key = 0;
+	if(cache)
+	{
+		key = shotCache::Key(t.StateHash(), angle, power, ballFactor);
+		if(cache->Lookup(key, out)) return;
+	}
+
+	//snap to the cache's grid so every shot sharing a key has the
+	//same outcome
+	angle = floor((angle/TT_ANGLE_STEP) + 0.5f)*TT_ANGLE_STEP;
+	power = floor((power/TT_POWER_STEP) + 0.5f)*TT_POWER_STEP;
+
+	table scratch(t);
+	scratch.ApplyImpulse(0, vec2((-sin(angle) * power * ballFactor), (-cos(angle) * power * ballFactor)));
+	out.steps = 0;
+	while(scratch.AnyBallsMoving() && out.steps<TT_MAX_STEPS)
+	{
+		scratch.Update(SIM_UPDATE_MS);
+		out.steps++;
+	}
+	out.numBalls = scratch.NumBalls();
+	out.positions.resize(out.numBalls);
+	for(int i=0;i<out.numBalls;i++) out.positions[i] = scratch.balls[i].position;
+	out.stateHash = scratch.StateHash();
+
+	if(cache) cache->Insert(key, out);
+}
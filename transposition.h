@@ -0,0 +1,103 @@
+/*-----------------------------------------------------------
+  Transposition Cache Header File
+  Maps (table state hash, quantised shot) to the simulated
+  outcome so that a planner re-trying the same shot from the
+  same position does not run the solver again.
+  -----------------------------------------------------------*/
+#ifndef transposition_h_included
+#define transposition_h_included
+
+#include"simulation.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define TT_SHARDS			(16)		//independently locked parts
+#define TT_WAYS				(8)			//entries a key can live in
+#define TT_SETS_PER_SHARD	(64)		//so capacity is up to 16*64*8 outcomes
+#define TT_POSITION_BYTES	(16*1024*1024)	//big tables get fewer sets to stay inside this
+#define TT_ANGLE_STEP		(0.0001f)	//radians
+#define TT_POWER_STEP		(0.0001f)
+#define TT_MAX_STEPS		(100000)	//give up simulating after this
+
+/*-----------------------------------------------------------
+  shotOutcome : the table at rest after a shot
+  -----------------------------------------------------------*/
+struct shotOutcome
+{
+	int					numBalls;
+	std::vector<vec2>	positions;	//every ball
+	int					steps;		//simulation steps until rest
+	uint64_t			stateHash;	//hash of the resting table
+};
+
+/*-----------------------------------------------------------
+  shotCache class
+  A fixed size, set associative cache. Keys are split over
+  TT_SHARDS shards, each with its own lock, and within a set
+  of TT_WAYS entries the victim is picked with the clock
+  (second chance) algorithm. Positions are stored for the
+  ball count given at construction; nothing is allocated
+  after that.
+  -----------------------------------------------------------*/
+class shotCache
+{
+private:
+	struct entry
+	{
+		uint64_t	key;
+		bool		valid;
+		bool		referenced;
+		int			numBalls;
+		int			steps;
+		uint64_t	stateHash;
+		vec2		*positions;		//maxBalls of them, in the shared pool
+	};
+	struct set
+	{
+		entry	ways[TT_WAYS];
+		int		hand;
+	};
+	struct shard
+	{
+		std::mutex	lock;
+		set			*sets;	//setsPerShard of them
+	};
+	shard	*shards;
+	int		setsPerShard;
+	int		maxBalls;
+	vec2	*positions;
+	std::atomic<bool> warned;
+
+	set &SetFor(uint64_t key, std::mutex *&lock);
+
+	shotCache(const shotCache &);
+	shotCache &operator =(const shotCache &);
+
+public:
+	std::atomic<long> hits;
+	std::atomic<long> misses;
+	std::atomic<long> evictions;
+	std::atomic<long> refused;		//outcomes with more balls than the cache was built for
+
+	//maxBalls is normally the table's NumBalls()
+	shotCache(int maxBalls);
+	~shotCache();
+
+	//ballFactor scales the impulse, so different factors are different shots
+	static uint64_t Key(uint64_t stateHash, float angle, float power, float ballFactor);
+	bool Lookup(uint64_t key, shotOutcome &out);
+	void Insert(uint64_t key, const shotOutcome &outcome);
+	void Clear(void);
+	int MaxBalls(void) const {return maxBalls;}
+};
+
+//the planner entry point : the outcome of playing (angle, power) on
+//t, from the cache when it has been seen before and otherwise by
+//stepping a scratch copy to rest (and remembering it). cache may be 0
+void SimulateShot(const table &t, float angle, float power, float ballFactor, shotOutcome &out, shotCache *cache);
+
+#endif
@@ -0,0 +1,122 @@
+/*-----------------------------------------------------------
+  Vector Environment Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"vecenv.h"
+#include"prediction.h"
+#include <chrono>
+#include <random>
+
+/*-----------------------------------------------------------
+  vecEnv class members
+  -----------------------------------------------------------*/
+vecEnv::vecEnv(int numThreads):pool(numThreads, true),actions(0),observations(0),rewards(0),dones(0)
+{
+}
+
+void vecEnv::Observe(int i)
+{
+	float *o = observations + (i*VECENV_OBS_SIZE);
+	const table &t = tables[i];
+	for(int b=0;b<NUM_BALLS;b++)
+	{
+		o[b*2] = (float)t.balls[b].position(0);
+		o[b*2+1] = (float)t.balls[b].position(1);
+	}
+}
+
+void vecEnv::Reset(int n, float *obs)
+{
+	if((int)tables.size()!=n)
+	{
+		tables.resize(n);
+		shots.resize(n);
+	}
+	observations = obs;
+	for(int i=0;i<n;i++)
+	{
+		tables[i].Reset();
+		shots[i] = 0;
+		Observe(i);
+	}
+}
+
+void vecEnv::StepOne(int i)
+{
+	table &t = tables[i];
+	float angle = actions[i*2];
+	float power = actions[i*2+1];
+	vec2 imp((-sin(angle) * power * CUE_BALL_FACTOR), (-cos(angle) * power * CUE_BALL_FACTOR));
+
+	//every ball is at rest when a shot is taken, so the closed form
+	//first contact of the cue ball is exact
+	ballPrediction pr;
+	PredictBall(t, 0, imp, pr);
+	rewards[i] = (pr.contactType==CONTACT_BALL) ? 1.0f : -1.0f;
+
+	t.ApplyImpulse(0, imp);
+	for(int s=0;s<VECENV_MAX_STEPS && t.AnyBallsMoving();s++) t.Update(SIM_UPDATE_MS);
+	if(t.AnyBallsMoving()) t.Reset();
+
+	if(++shots[i]>=VECENV_EPISODE_SHOTS)
+	{
+		dones[i] = 1;
+		t.Reset();
+		shots[i] = 0;
+	}
+	else dones[i] = 0;
+	Observe(i);
+}
+
+void vecEnv::StepRange(void *context, int first, int last)
+{
+	vecEnv *env = (vecEnv *)context;
+	for(int i=first;i<last;i++) env->StepOne(i);
+}
+
+void vecEnv::Step(const float *act, float *obs, float *rew, unsigned char *done)
+{
+	actions = act;
+	observations = obs;
+	rewards = rew;
+	dones = done;
+	pool.ParallelFor(NumEnvs(), VECENV_GRAIN, StepRange, this);
+}
+
+/*-----------------------------------------------------------
+  console mode
+  -----------------------------------------------------------*/
+int RunVecEnvBenchmark(int numEnvs, int numThreads, int seconds)
+{
+	vecEnv env(numThreads);
+	std::vector<float> obs(numEnvs*VECENV_OBS_SIZE);
+	std::vector<float> act(numEnvs*2);
+	std::vector<float> rew(numEnvs);
+	std::vector<unsigned char> done(numEnvs);
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> angle(0.0f, TWO_PI);
+	std::uniform_real_distribution<float> power(0.1f, 0.75f);
+
+	env.Reset(numEnvs, &obs[0]);
+	long shots = 0;
+	double hits = 0.0;
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	std::chrono::duration<double> elapsed(0.0);
+	while(elapsed.count()<seconds)
+	{
+		for(int i=0;i<numEnvs;i++)
+		{
+			act[i*2] = angle(rng);
+			act[i*2+1] = power(rng);
+		}
+		env.Step(&act[0], &obs[0], &rew[0], &done[0]);
+		shots += numEnvs;
+		for(int i=0;i<numEnvs;i++) if(rew[i]>0.0f) hits++;
+		elapsed = clock::now() - start;
+	}
+	printf("%d envs, %d threads : %ld shots in %.2f s, %.0f shots/s, %.1f%% hit a ball first\n",
+		numEnvs, env.NumThreads(),
+		shots, elapsed.count(), shots/elapsed.count(), (100.0*hits)/shots);
+	return 0;
+}
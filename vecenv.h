@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------
+  Vector Environment Header File
+  Gym style batch interface over many tables, for training
+  shot policies. Buffers are the caller's : observations,
+  rewards and done flags are written straight into them.
+  -----------------------------------------------------------*/
+#ifndef vecenv_h_included
+#define vecenv_h_included
+
+#include"simulation.h"
+#include"workerpool.h"
+#include <vector>
+
+/*-----------------------------------------------------------
+  Macros
+  -----------------------------------------------------------*/
+#define VECENV_OBS_SIZE			(NUM_BALLS*2)	//x,z of each ball
+#define VECENV_EPISODE_SHOTS	(10)			//shots before an episode is done
+#define VECENV_MAX_STEPS		(100000)		//cap on steps simulating one shot
+#define VECENV_GRAIN			(8)				//tables handed to a thread at a time
+
+/*-----------------------------------------------------------
+  vecEnv class
+  reset(N) racks N tables with the ball::Reset layout.
+  step(actions) plays one shot (angle, power) on every table,
+  simulates it to rest and writes :
+	observations	N*VECENV_OBS_SIZE floats
+	rewards			N floats : +1 if the cue ball's first contact
+					is an object ball, -1 if it touches a cushion
+					first or nothing at all
+	dones			N bytes : 1 when the episode's shots are used
+					up; that table is re-racked and its row of
+					observations is the new episode's first
+  Tables are simulated in parallel on a worker pool.
+  -----------------------------------------------------------*/
+class vecEnv
+{
+private:
+	std::vector<table>	tables;
+	std::vector<int>	shots;
+	workerPool			pool;
+
+	//the buffers of the step in progress
+	const float		*actions;
+	float			*observations;
+	float			*rewards;
+	unsigned char	*dones;
+
+	static void StepRange(void *context, int first, int last);
+	void StepOne(int i);
+	void Observe(int i);
+
+public:
+	//numThreads 0 means one per hardware thread
+	vecEnv(int numThreads = 0);
+
+	int NumEnvs(void) const {return (int)tables.size();}
+	int NumThreads(void) const {return pool.NumThreads();}
+	void Reset(int n, float *obs);
+	void Step(const float *act, float *obs, float *rew, unsigned char *done);
+	const table &Table(int i) const {return tables[i];}
+};
+
+//console mode : shots per second with random actions
+int RunVecEnvBenchmark(int numEnvs, int numThreads, int seconds);
+
+#endif
@@ -6,6 +6,57 @@
 
 #include <math.h>
 
+/*------------------------------------------------------------------------
+	SIMD selection : vec4 uses SSE when the target has it (define
+	VECMATH_NO_SIMD to force the scalar fallback), and FMA when the
+	compiler is allowed to emit it (-mfma, /arch:AVX2)
+  ------------------------------------------------------------------------*/
+#if !defined(VECMATH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1)))
+#define VECMATH_SSE		(1)
+#include <xmmintrin.h>
+#include <new>
+#if defined(__FMA__) || defined(__AVX2__)
+#define VECMATH_FMA		(1)
+#include <immintrin.h>
+#endif
+#else
+#define VECMATH_SSE		(0)
+#endif
+
+#if defined(_MSC_VER)
+#define VECMATH_ALIGN16	__declspec(align(16))
+#else
+#define VECMATH_ALIGN16	__attribute__((aligned(16)))
+#endif
+
+//operator new does not honour 16 byte alignment on every platform (32 bit
+//msvc only gives 8), so classes holding a vec4 that are created with new
+//must pull these in. The block comes from the global operator new, padded
+//and aligned by hand (the shift is kept in the byte before), so that
+//anything hooking operator new sees these allocations too
+#if VECMATH_SSE
+inline void *VecmathAlignedAlloc(size_t n)
+{
+	unsigned char *raw = (unsigned char *)::operator new(n + 16);
+	unsigned char *p = (unsigned char *)(((size_t)raw + 16) & ~(size_t)15);
+	p[-1] = (unsigned char)(p - raw);
+	return p;
+}
+inline void VecmathAlignedFree(void *p)
+{
+	if(!p) return;
+	unsigned char *q = (unsigned char *)p;
+	::operator delete(q - q[-1]);
+}
+#define VECMATH_ALIGNED_NEW \
+	static void *operator new(size_t n) {return VecmathAlignedAlloc(n);} \
+	static void *operator new[](size_t n) {return VecmathAlignedAlloc(n);} \
+	static void operator delete(void *p) {VecmathAlignedFree(p);} \
+	static void operator delete[](void *p) {VecmathAlignedFree(p);}
+#else
+#define VECMATH_ALIGNED_NEW
+#endif
+
 /*------------------------------------------------------------------------
 	vec2 : 2d Vector
   ------------------------------------------------------------------------*/
@@ -87,4 +138,123 @@ public:
     }
 };
 
+/*------------------------------------------------------------------------
+	vec4 : 4 lane single precision vector, 16 byte aligned
+	The 3d operations (Dot3, Cross3, Normalised3...) work on x,y,z and
+	leave w at zero for vectors built from 3 components.
+  ------------------------------------------------------------------------*/
+class VECMATH_ALIGN16 vec4
+{
+public:
+#if VECMATH_SSE
+	union
+	{
+		__m128	v;
+		float	elem[4];
+	};
+#else
+	float	elem[4];
+#endif
+
+public:
+	vec4(){}
+#if VECMATH_SSE
+	vec4(__m128 x) : v(x) {}
+	vec4(float x, float y, float z, float w = 0.0f) : v(_mm_set_ps(w,z,y,x)) {}
+	explicit vec4(float x) : v(_mm_set1_ps(x)) {}
+	explicit vec4(const vec3 &x) : v(_mm_set_ps(0.0f,(float)x.elem[2],(float)x.elem[1],(float)x.elem[0])) {}
+#else
+	vec4(float x, float y, float z, float w = 0.0f) {elem[0]=x; elem[1]=y; elem[2]=z; elem[3]=w;}
+	explicit vec4(float x) {elem[0]=elem[1]=elem[2]=elem[3]=x;}
+	explicit vec4(const vec3 &x) {elem[0]=(float)x.elem[0]; elem[1]=(float)x.elem[1]; elem[2]=(float)x.elem[2]; elem[3]=0.0f;}
+#endif
+
+	float operator()(int x) const {return elem[x];}
+	float &operator()(int x) {return elem[x];}
+	vec3 ToVec3(void) const {return vec3(elem[0],elem[1],elem[2]);}
+
+#if VECMATH_SSE
+	vec4 operator +(const vec4 &x) const {return vec4(_mm_add_ps(v,x.v));}
+	vec4 operator -(const vec4 &x) const {return vec4(_mm_sub_ps(v,x.v));}
+	vec4 operator *(const vec4 &x) const {return vec4(_mm_mul_ps(v,x.v));}
+	vec4 operator *(const float x) const {return vec4(_mm_mul_ps(v,_mm_set1_ps(x)));}
+	vec4 operator /(const float x) const {return vec4(_mm_mul_ps(v,_mm_set1_ps(1.0f/x)));}
+	vec4 operator -() const {return vec4(_mm_sub_ps(_mm_setzero_ps(),v));}
+	vec4 &operator +=(const vec4 &x) {v = _mm_add_ps(v,x.v); return (*this);}
+	vec4 &operator -=(const vec4 &x) {v = _mm_sub_ps(v,x.v); return (*this);}
+	vec4 &operator *=(const float x) {v = _mm_mul_ps(v,_mm_set1_ps(x)); return (*this);}
+
+	//fused (this * m) + a
+	vec4 MulAdd(const vec4 &m, const vec4 &a) const
+	{
+	#if VECMATH_FMA
+		return vec4(_mm_fmadd_ps(v,m.v,a.v));
+	#else
+		return vec4(_mm_add_ps(_mm_mul_ps(v,m.v),a.v));
+	#endif
+	}
+	vec4 MulAdd(const float m, const vec4 &a) const {return MulAdd(vec4(m),a);}
+
+	float Dot3(const vec4 &x) const {return _mm_cvtss_f32(Dot3Splat(v,x.v));}
+	float Magnitude2(void) const {return Dot3(*this);}
+	float Magnitude(void) const {return _mm_cvtss_f32(_mm_sqrt_ss(Dot3Splat(v,v)));}
+
+	//reciprocal square root estimate refined with one newton-raphson step,
+	//good to roughly 22 bits which is plenty for directions
+	vec4 Normalised3(void) const
+	{
+		__m128 d = Dot3Splat(v,v);
+		__m128 r = _mm_rsqrt_ps(d);
+		r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f),r),_mm_sub_ps(_mm_set1_ps(3.0f),_mm_mul_ps(_mm_mul_ps(d,r),r)));
+		return vec4(_mm_mul_ps(v,r));
+	}
+
+	//a.yzx*b.zxy - a.zxy*b.yzx, w comes out as zero
+	vec4 Cross3(const vec4 &x) const
+	{
+		__m128 a_yzx = _mm_shuffle_ps(v,v,_MM_SHUFFLE(3,0,2,1));
+		__m128 b_yzx = _mm_shuffle_ps(x.v,x.v,_MM_SHUFFLE(3,0,2,1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(v,b_yzx),_mm_mul_ps(a_yzx,x.v));
+		return vec4(_mm_shuffle_ps(c,c,_MM_SHUFFLE(3,0,2,1)));
+	}
+
+private:
+	static __m128 Dot3Splat(__m128 a, __m128 b)
+	{
+		__m128 m = _mm_mul_ps(a,b);
+		__m128 y = _mm_shuffle_ps(m,m,_MM_SHUFFLE(1,1,1,1));
+		__m128 z = _mm_shuffle_ps(m,m,_MM_SHUFFLE(2,2,2,2));
+		m = _mm_shuffle_ps(m,m,_MM_SHUFFLE(0,0,0,0));
+		return _mm_add_ps(_mm_add_ps(m,y),z);
+	}
+#else
+	vec4 operator +(const vec4 &x) const {return vec4(elem[0]+x.elem[0],elem[1]+x.elem[1],elem[2]+x.elem[2],elem[3]+x.elem[3]);}
+	vec4 operator -(const vec4 &x) const {return vec4(elem[0]-x.elem[0],elem[1]-x.elem[1],elem[2]-x.elem[2],elem[3]-x.elem[3]);}
+	vec4 operator *(const vec4 &x) const {return vec4(elem[0]*x.elem[0],elem[1]*x.elem[1],elem[2]*x.elem[2],elem[3]*x.elem[3]);}
+	vec4 operator *(const float x) const {return vec4(elem[0]*x,elem[1]*x,elem[2]*x,elem[3]*x);}
+	vec4 operator /(const float x) const {return (*this)*(1.0f/x);}
+	vec4 operator -() const {return vec4(-elem[0],-elem[1],-elem[2],-elem[3]);}
+	vec4 &operator +=(const vec4 &x) {elem[0]+=x.elem[0]; elem[1]+=x.elem[1]; elem[2]+=x.elem[2]; elem[3]+=x.elem[3]; return (*this);}
+	vec4 &operator -=(const vec4 &x) {elem[0]-=x.elem[0]; elem[1]-=x.elem[1]; elem[2]-=x.elem[2]; elem[3]-=x.elem[3]; return (*this);}
+	vec4 &operator *=(const float x) {elem[0]*=x; elem[1]*=x; elem[2]*=x; elem[3]*=x; return (*this);}
+
+	//(this * m) + a
+	vec4 MulAdd(const vec4 &m, const vec4 &a) const {return vec4(elem[0]*m.elem[0]+a.elem[0],elem[1]*m.elem[1]+a.elem[1],elem[2]*m.elem[2]+a.elem[2],elem[3]*m.elem[3]+a.elem[3]);}
+	vec4 MulAdd(const float m, const vec4 &a) const {return vec4(elem[0]*m+a.elem[0],elem[1]*m+a.elem[1],elem[2]*m+a.elem[2],elem[3]*m+a.elem[3]);}
+
+	float Dot3(const vec4 &x) const {return (elem[0]*x.elem[0]) + (elem[1]*x.elem[1]) + (elem[2]*x.elem[2]);}
+	float Magnitude2(void) const {return Dot3(*this);}
+	float Magnitude(void) const {return sqrtf(Dot3(*this));}
+	vec4 Normalised3(void) const {float r = 1.0f/sqrtf(Dot3(*this)); return vec4(elem[0]*r,elem[1]*r,elem[2]*r,elem[3]*r);}
+
+	vec4 Cross3(const vec4 &x) const
+	{
+		return vec4(elem[1]*x.elem[2] - elem[2]*x.elem[1],
+					elem[2]*x.elem[0] - elem[0]*x.elem[2],
+					elem[0]*x.elem[1] - elem[1]*x.elem[0], 0.0f);
+	}
+#endif
+};
+
+
 #endif
\ No newline at end of file
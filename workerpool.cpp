@@ -0,0 +1,94 @@
+/*-----------------------------------------------------------
+  Worker Pool Source File
+  -----------------------------------------------------------*/
+#include"stdafx.h"
+#include"workerpool.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+/*-----------------------------------------------------------
+  helpers
+  -----------------------------------------------------------*/
+static void PinToCore(std::thread &t, int core)
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	if(cores==0) return;
+	core %= cores;
+#ifdef _WIN32
+	SetThreadAffinityMask(t.native_handle(), ((DWORD_PTR)1) << core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#endif
+}
+
+/*-----------------------------------------------------------
+  workerPool class members
+  -----------------------------------------------------------*/
+workerPool::workerPool(int numThreads, bool pin):
+	generation(0), pending(0), quit(false), nextChunk(0), count(0), grain(1), func(0), context(0)
+{
+	if(numThreads<=0) numThreads = (int)std::thread::hardware_concurrency();
+	if(numThreads<=0) numThreads = 1;
+	for(int i=0;i<numThreads;i++)
+	{
+		threads.push_back(std::thread(&workerPool::Worker, this));
+		if(pin) PinToCore(threads.back(), i);
+	}
+}
+
+workerPool::~workerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for(size_t i=0;i<threads.size();i++) threads[i].join();
+}
+
+void workerPool::Worker(void)
+{
+	unsigned int seen = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while(!quit && generation==seen) wake.wait(guard);
+			if(quit) return;
+			seen = generation;
+		}
+		for(;;)
+		{
+			int first = (nextChunk++)*grain;
+			if(first>=count) break;
+			func(context, first, std::min(first+grain, count));
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if(--pending==0) done.notify_one();
+		}
+	}
+}
+
+void workerPool::ParallelFor(int n, int g, workerFunc f, void *ctx)
+{
+	if(n<=0) return;
+	std::unique_lock<std::mutex> guard(lock);
+	count = n;
+	grain = (g<1) ? 1 : g;
+	func = f;
+	context = ctx;
+	nextChunk = 0;
+	pending = (int)threads.size();
+	generation++;
+	wake.notify_all();
+	while(pending>0) done.wait(guard);
+}
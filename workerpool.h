@@ -0,0 +1,56 @@
+/*-----------------------------------------------------------
+  Worker Pool Header File
+  A fixed set of (optionally core pinned) threads that split
+  a range of work between them and wait for each other.
+  -----------------------------------------------------------*/
+#ifndef workerpool_h_included
+#define workerpool_h_included
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*-----------------------------------------------------------
+  workerPool class
+  ParallelFor hands out [0,count) in chunks of grain items;
+  each thread takes whole chunks, so neighbouring items are
+  processed together. The calling thread blocks until every
+  chunk is done. Nothing is allocated per call.
+  -----------------------------------------------------------*/
+typedef void (*workerFunc)(void *context, int first, int last);
+
+class workerPool
+{
+private:
+	std::vector<std::thread> threads;
+	std::mutex				lock;
+	std::condition_variable	wake;
+	std::condition_variable	done;
+	unsigned int			generation;
+	int						pending;
+	bool					quit;
+
+	//the current job
+	std::atomic<int>		nextChunk;
+	int						count;
+	int						grain;
+	workerFunc				func;
+	void					*context;
+
+	void Worker(void);
+
+	workerPool(const workerPool &);
+	workerPool &operator =(const workerPool &);
+
+public:
+	//numThreads 0 means one per hardware thread
+	workerPool(int numThreads, bool pin);
+	~workerPool();
+
+	int NumThreads(void) const {return (int)threads.size();}
+	void ParallelFor(int count, int grain, workerFunc f, void *context);
+};
+
+#endif